@@ -0,0 +1,89 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "metrics.h"
+#include "adapt.h"
+
+#define ADAPT_WINDOW	1000000	/* us between decisions */
+#define MAX_WRITE_RATE	64	/* writes per second before growing */
+#define MAX_BUSY	4	/* grow when writing takes over 1/4 of the time */
+
+void adapt_init(struct adapt *a, const char *name, uint32_t size,
+	uint32_t min, uint32_t max, uint32_t step, int latency_ms)
+{
+	a->name = name;
+	a->step = step;
+	a->min = (min + step - 1) / step * step;
+	a->max = max / step * step;
+	if (a->max < a->min) {
+		a->max = a->min;}
+	a->size = size / step * step;
+	if (a->size < a->min) {
+		a->size = a->min;}
+	if (a->size > a->max) {
+		a->size = a->max;}
+	a->latency = (uint64_t)latency_ms * 1000;
+	a->window_start = metrics_now();
+	a->calls = a->busy = a->worst_age = 0;
+	fprintf(stderr, "Adaptive %s size %u bytes, between %u and %u.\n",
+		a->name, a->size, a->min, a->max);
+}
+
+static void adapt_set(struct adapt *a, uint32_t size, double rate, double busy)
+{
+	size = size / a->step * a->step;
+	if (size < a->min) {
+		size = a->min;}
+	if (size > a->max) {
+		size = a->max;}
+	if (size == a->size) {
+		return;}
+	fprintf(stderr, "Adaptive %s size %u -> %u bytes "
+		"(%.0f writes/s, %.0f%% busy, %.1f ms latency).\n",
+		a->name, a->size, size, rate, busy * 100, a->worst_age / 1000.0);
+	a->size = size;
+}
+
+uint32_t adapt_update(struct adapt *a, uint64_t write_us, uint64_t age_us)
+{
+	uint64_t t = metrics_now();
+	uint64_t elapsed = t - a->window_start;
+	double rate, busy;
+
+	a->calls++;
+	a->busy += write_us;
+	if (age_us > a->worst_age) {
+		a->worst_age = age_us;}
+	if (elapsed < ADAPT_WINDOW) {
+		return a->size;}
+
+	rate = a->calls * 1e6 / elapsed;
+	busy = (double)a->busy / elapsed;
+	if (a->latency && a->worst_age > a->latency) {
+		adapt_set(a, a->size / 2, rate, busy);
+	} else if (rate > MAX_WRITE_RATE || busy * MAX_BUSY > 1) {
+		/* doubling roughly doubles the age of the oldest sample */
+		if (!a->latency || a->worst_age * 2 <= a->latency) {
+			adapt_set(a, a->size * 2, rate, busy);}
+	}
+
+	a->window_start = t;
+	a->calls = a->busy = a->worst_age = 0;
+	return a->size;
+}
@@ -0,0 +1,68 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __ADAPT_H
+#define __ADAPT_H
+
+#include <stdint.h>
+
+/* adaptive block sizing
+ *
+ * Once a second the size is doubled when writes are frequent or
+ * take a large share of the time, and halved when samples wait
+ * longer than the latency target before they reach the file.
+ */
+
+struct adapt {
+	const char *name;
+	uint32_t size;
+	uint32_t min, max;
+	uint32_t step;		/* sizes stay a multiple of this */
+	uint64_t latency;	/* us, 0 for no latency target */
+	uint64_t window_start;
+	uint64_t calls;
+	uint64_t busy;		/* us spent writing in this window */
+	uint64_t worst_age;	/* us, oldest sample at write time */
+};
+
+/*!
+ * Set up a size controller
+ *
+ * \param a the controller
+ * \param name reported in the log
+ * \param size starting size in bytes
+ * \param min smallest size
+ * \param max largest size
+ * \param step granularity of the size
+ * \param latency_ms target for samples to reach the output, 0 for none
+ */
+
+void adapt_init(struct adapt *a, const char *name, uint32_t size,
+	uint32_t min, uint32_t max, uint32_t step, int latency_ms);
+
+/*!
+ * Record one write and maybe change the size
+ *
+ * \param a the controller
+ * \param write_us time taken by the write
+ * \param age_us time since the oldest written sample arrived
+ * \return the size to use for the next write
+ */
+
+uint32_t adapt_update(struct adapt *a, uint64_t write_us, uint64_t age_us);
+
+#endif
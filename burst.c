@@ -0,0 +1,496 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "rtl-sdr.h"
+#include "convenience.h"
+#include "metrics.h"
+#include "dsp.h"
+#include "burst.h"
+
+#define DETECT_FRAMES	64	/* frames read out of the ring at a time */
+
+/* the floor follows the power down quickly and up slowly, so a
+ * burst the threshold missed barely lifts it */
+#define FLOOR_FALL	0.05f
+#define FLOOR_RISE	0.001f
+
+int bursts_open(struct bursts *b, const char *spec, struct ring *ring,
+	uint32_t samp_rate, uint32_t frequency)
+{
+	burst_header_t h;
+	char buf[1100], path[1100];
+	char *dest, *threshold, *hold, *padding, *workers;
+	int archive;
+
+	memset(b, 0, sizeof(*b));
+	b->ring = ring;
+	b->samp_rate = samp_rate;
+	b->frequency = frequency;
+	b->cpu = -1;
+	snprintf(buf, sizeof(buf), "%s", spec);
+	dest = strtok(buf, ",");
+	threshold = strtok(NULL, ",");
+	hold = strtok(NULL, ",");
+	padding = strtok(NULL, ",");
+	workers = strtok(NULL, ",");
+	if (!dest) {
+		fprintf(stderr, "Bursts need a destination.\n");
+		return -1;
+	}
+	archive = strncmp(dest, BURST_ARCHIVE, strlen(BURST_ARCHIVE)) == 0;
+	snprintf(b->dest, sizeof(b->dest), "%s", archive ? dest + strlen(BURST_ARCHIVE) : dest);
+
+	b->threshold = threshold ? atof(threshold) : 10;
+	b->hold = (uint32_t)ceil((hold ? atof(hold) : 5) * samp_rate / 1000 / BURST_FRAME);
+	if (!b->hold) {
+		b->hold = 1;}
+	b->pad = (uint32_t)((padding ? atof(padding) : 1) * samp_rate / 1000);
+	b->nworkers = workers ? atoi(workers) : 2;
+	if (b->nworkers < 1) {
+		b->nworkers = 1;}
+	if (b->nworkers > BURST_WORKERS) {
+		b->nworkers = BURST_WORKERS;}
+	/* a quarter of the ring, the rest is for the detector and the
+	 * workers to fall behind by */
+	b->longest = ring->size / 2 / 4 < UINT32_MAX ? ring->size / 2 / 4 : UINT32_MAX;
+	if (b->longest < 2 * b->pad + BURST_FRAME) {
+		fprintf(stderr, "Bursts: the padding does not fit in the ring.\n");
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s%s", b->dest, BURST_SUFFIX);
+	b->index = fopen(path, "wb");
+	if (!b->index) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, BURST_MAGIC, 4);
+	h.version = BURST_VERSION;
+	h.record_size = sizeof(burst_record_t);
+	h.samp_rate = samp_rate;
+	fwrite(&h, 1, sizeof(h), b->index);
+	fflush(b->index);
+
+	if (archive) {
+		b->archive = fopen(b->dest, "wb");
+		if (!b->archive) {
+			fprintf(stderr, "Failed to open %s\n", b->dest);
+			fclose(b->index);
+			b->index = NULL;
+			return -1;
+		}
+		wave_header(b->archive, samp_rate, frequency, 8);
+		fflush(b->archive);
+	}
+
+	pthread_mutex_init(&b->lock, NULL);
+	pthread_cond_init(&b->more, NULL);
+	sem_init(&b->wake, 0, 0);
+	return 0;
+}
+
+/* hand a burst to the workers */
+static void bursts_queue(struct bursts *b, const struct burst_job *job)
+{
+	pthread_mutex_lock(&b->lock);
+	if (b->count == BURST_JOBS) {
+		__atomic_add_fetch(&b->dropped, 1, __ATOMIC_RELAXED);
+	} else {
+		b->jobs[(b->head + b->count) % BURST_JOBS] = *job;
+		b->count++;
+		pthread_cond_signal(&b->more);
+	}
+	pthread_mutex_unlock(&b->lock);
+}
+
+/* queue the closed bursts whose padding after is in the ring */
+static void bursts_release(struct bursts *b)
+{
+	int n = 0;
+	while (n < b->nwaiting && b->waiting[n].ready <= b->pos) {
+		bursts_queue(b, &b->waiting[n++]);}
+	b->nwaiting -= n;
+	memmove(b->waiting, b->waiting + n, b->nwaiting * sizeof(b->waiting[0]));
+}
+
+static void bursts_begin(struct bursts *b, float p, uint64_t head)
+{
+	struct burst_job *c = &b->cur;
+	uint32_t pad = b->pad;
+
+	memset(c, 0, sizeof(*c));
+	if (pad > b->pos) {
+		pad = b->pos;
+		c->flags |= BURST_CLIPPED;
+	}
+	c->sample = b->pos - pad;
+	c->pad = pad;
+	c->core = BURST_FRAME;
+	c->frequency = __atomic_load_n(&b->frequency, __ATOMIC_RELAXED);
+	c->floor = b->floor;
+	c->time_ns = metrics_wallclock_ns(metrics_now())
+		- (int64_t)(head - c->sample) * 1000000000 / b->samp_rate;
+	b->sum = p;
+	b->loud = 1;
+	b->quiet = 0;
+	b->active = 1;
+}
+
+static void bursts_end(struct bursts *b, uint32_t flags)
+{
+	struct burst_job *c = &b->cur;
+
+	b->active = 0;
+	c->flags |= flags;
+	if (flags & BURST_CUT) {
+		c->core = b->pos - c->sample - c->pad;}
+	c->power = 10 * log10f(b->sum / b->loud);
+	c->ready = c->sample + c->pad + c->core + b->pad;
+	c->length = c->ready - c->sample;
+	if (b->nwaiting == BURST_JOBS) {
+		__atomic_add_fetch(&b->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	b->waiting[b->nwaiting++] = *c;
+}
+
+/* measure one frame, the one at b->pos */
+static void bursts_frame(struct bursts *b, const uint8_t *frame, uint64_t head)
+{
+	float p = mean_power(frame, BURST_FRAME * 2);
+	float db = p > 0 ? 10 * log10f(p) : -100;
+	int loud;
+
+	if (!b->floor_set) {
+		b->floor = db;
+		b->floor_set = 1;
+	}
+	loud = db > b->floor + b->threshold;
+	if (!b->active) {
+		if (loud) {
+			bursts_begin(b, p, head);
+		} else {
+			b->floor += (db - b->floor) * (db < b->floor ? FLOOR_FALL : FLOOR_RISE);}
+	} else if (loud) {
+		b->sum += p;
+		b->loud++;
+		b->quiet = 0;
+		b->cur.core = b->pos + BURST_FRAME - b->cur.sample - b->cur.pad;
+	} else if (++b->quiet >= b->hold) {
+		bursts_end(b, 0);
+	}
+	b->pos += BURST_FRAME;
+	if (b->active && b->pos - b->cur.sample + b->pad >= b->longest) {
+		bursts_end(b, BURST_CUT);}
+}
+
+/* the detector fell so far behind the ring was overwritten under it,
+ * carry on from the head with whatever burst it was in given up */
+static void bursts_skip(struct bursts *b, uint64_t head)
+{
+	__atomic_add_fetch(&b->lost, head - b->pos, __ATOMIC_RELAXED);
+	if (b->active) {
+		__atomic_add_fetch(&b->failed, 1, __ATOMIC_RELAXED);}
+	b->active = 0;
+	b->pos = head;
+}
+
+static void *bursts_detect(void *arg)
+{
+	struct bursts *b = arg;
+	uint8_t *buf = malloc(DETECT_FRAMES * BURST_FRAME * 2);
+	uint64_t head, n;
+	int i, stopping;
+
+	if (!buf) {
+		fprintf(stderr, "WARNING: Out of memory, no bursts are detected.\n");
+		return NULL;
+	}
+	verbose_cpu_affinity("bursts", b->cpu);
+	b->pos = ring_head(b->ring) / 2;
+	while (1) {
+		if (sem_wait(&b->wake) < 0)
+			continue;
+		stopping = b->stop;
+		head = ring_head(b->ring) / 2;
+		/* keep clear of the part of the ring the next push overwrites */
+		if (head - b->pos > (b->ring->size - b->ring->most) / 2) {
+			bursts_skip(b, head);}
+		while (head - b->pos >= BURST_FRAME) {
+			n = (head - b->pos) / BURST_FRAME;
+			if (n > DETECT_FRAMES) {
+				n = DETECT_FRAMES;}
+			if (ring_read(b->ring, b->pos * 2, buf, n * BURST_FRAME * 2) < 0) {
+				bursts_skip(b, ring_head(b->ring) / 2);
+				break;
+			}
+			for (i = 0; i < (int)n; i++) {
+				bursts_frame(b, buf + i * BURST_FRAME * 2, head);}
+			__atomic_add_fetch(&b->measured, n * BURST_FRAME, __ATOMIC_RELAXED);
+		}
+		if (stopping)
+			break;
+		bursts_release(b);
+	}
+
+	/* the capture is over, the padding after is whatever there is */
+	if (b->active) {
+		bursts_end(b, 0);}
+	for (i = 0; i < b->nwaiting; i++) {
+		if (b->waiting[i].ready > b->pos) {
+			b->waiting[i].ready = b->pos;
+			b->waiting[i].length = b->pos - b->waiting[i].sample;
+		}
+	}
+	bursts_release(b);
+	free(buf);
+	return NULL;
+}
+
+/* frequency offset of a burst from the mean phase step between samples */
+static double bursts_offset(struct bursts *b, const int8_t *s, uint32_t n)
+{
+	int64_t re = 0, im = 0;
+	uint32_t k;
+	for (k = 1; k < n; k++) {
+		re += s[2*k] * s[2*k-2] + s[2*k+1] * s[2*k-1];
+		im += s[2*k+1] * s[2*k-2] - s[2*k] * s[2*k-1];
+	}
+	return atan2((double)im, (double)re) * b->samp_rate / (2 * M_PI);
+}
+
+static int bursts_write_file(struct bursts *b, const burst_record_t *r, const uint8_t *buf)
+{
+	char path[1100];
+	auxi_t auxi;
+	FILE *file;
+	size_t len = (size_t)r->length * 2;
+
+	snprintf(path, sizeof(path), "%s-%llu.wav", b->dest, (unsigned long long)r->sample);
+	file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "WARNING: Failed to open %s for a burst.\n", path);
+		return -1;
+	}
+	memset(&auxi, 0, sizeof(auxi));
+	auxi.frequency = r->frequency;
+	set_datetime_ns(&auxi.start_time, r->time_ns);
+	wave_header_auxi(file, b->samp_rate, 8, &auxi);
+	if (fwrite(buf, 1, len, file) != len || fflush(file) != 0 ||
+	    wave_update_sizes(fileno(file), len) < 0) {
+		fprintf(stderr, "WARNING: Short write, %s is cut short.\n", path);
+		fclose(file);
+		return -1;
+	}
+	fclose(file);
+	return 0;
+}
+
+static int bursts_write_archive(struct bursts *b, uint64_t offset, const uint8_t *buf, size_t len)
+{
+	ssize_t n;
+	while (len) {
+		n = pwrite(fileno(b->archive), buf, len, WAVE_HEADER_SIZE + offset);
+		if (n < 0 && errno == EINTR) {
+			continue;}
+		if (n <= 0) {
+			fprintf(stderr, "WARNING: Failed to write a burst to %s: %s\n",
+				b->dest, strerror(errno));
+			return -1;
+		}
+		buf += n;
+		offset += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void bursts_write(struct bursts *b, const struct burst_job *job, uint8_t *buf)
+{
+	burst_record_t r;
+	wave_cue_t *cue;
+	size_t len = (size_t)job->length * 2;
+	int failed;
+
+	if (ring_read(b->ring, job->sample * 2, buf, len) < 0) {
+		__atomic_add_fetch(&b->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	memset(&r, 0, sizeof(r));
+	r.sample = job->sample;
+	r.length = job->length;
+	r.frequency = job->frequency + (int32_t)lrint(bursts_offset(b,
+		(const int8_t *)buf + job->pad * 2, job->core));
+	r.power = job->power;
+	r.floor = job->floor;
+	r.time_ns = job->time_ns;
+	r.flags = job->flags;
+
+	/* the archive space is taken first, so the copy runs unlocked */
+	if (b->archive) {
+		pthread_mutex_lock(&b->lock);
+		r.offset = b->archive_bytes;
+		b->archive_bytes += len;
+		pthread_mutex_unlock(&b->lock);
+		failed = bursts_write_archive(b, r.offset, buf, len);
+	} else {
+		failed = bursts_write_file(b, &r, buf);
+	}
+	if (failed) {
+		__atomic_add_fetch(&b->failed, 1, __ATOMIC_RELAXED);}
+
+	pthread_mutex_lock(&b->lock);
+	fwrite(&r, 1, sizeof(r), b->index);
+	fflush(b->index);
+	if (b->archive) {
+		cue = realloc(b->cues, (b->ncues + 1) * sizeof(*cue));
+		if (cue) {
+			b->cues = cue;
+			cue = &b->cues[b->ncues++];
+			cue->position = r.offset / 2;
+			cue->length = r.length;
+			snprintf(cue->label, sizeof(cue->label), "burst %u Hz %.1f dBFS",
+				r.frequency, r.power);
+		} else {
+			fprintf(stderr, "WARNING: Out of memory, burst at %llu not marked.\n",
+				(unsigned long long)r.offset / 2);
+		}
+	}
+	pthread_mutex_unlock(&b->lock);
+	if (!failed) {
+		__atomic_add_fetch(&b->written, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&b->samples, r.length, __ATOMIC_RELAXED);
+	}
+}
+
+static void *bursts_work(void *arg)
+{
+	struct bursts *b = arg;
+	/* a burst can run up to a frame past the longest */
+	uint8_t *buf = malloc(((size_t)b->longest + BURST_FRAME) * 2);
+	struct burst_job job;
+
+	if (!buf) {
+		fprintf(stderr, "WARNING: Out of memory, a burst writer stopped.\n");
+		return NULL;
+	}
+	while (1) {
+		pthread_mutex_lock(&b->lock);
+		while (!b->count && !b->finished)
+			pthread_cond_wait(&b->more, &b->lock);
+		if (!b->count) {
+			pthread_mutex_unlock(&b->lock);
+			break;
+		}
+		job = b->jobs[b->head];
+		b->head = (b->head + 1) % BURST_JOBS;
+		b->count--;
+		pthread_mutex_unlock(&b->lock);
+		bursts_write(b, &job, buf);
+	}
+	free(buf);
+	return NULL;
+}
+
+int bursts_start(struct bursts *b, int cpu)
+{
+	int i;
+
+	b->cpu = cpu;
+	if (pthread_create(&b->detector, NULL, bursts_detect, b) != 0) {
+		fprintf(stderr, "Failed to start the burst detector.\n");
+		return -1;
+	}
+	for (i = 0; i < b->nworkers; i++) {
+		if (pthread_create(&b->workers[i], NULL, bursts_work, b) != 0) {
+			fprintf(stderr, "Failed to start a burst writer.\n");
+			break;
+		}
+	}
+	b->nworkers = i;
+	b->running = 1;
+	return i ? 0 : -1;
+}
+
+void bursts_notify(struct bursts *b)
+{
+	if (b->running)
+		sem_post(&b->wake);
+}
+
+void bursts_tune(struct bursts *b, uint32_t frequency)
+{
+	__atomic_store_n(&b->frequency, frequency, __ATOMIC_RELAXED);
+}
+
+void bursts_report(struct bursts *b, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s written %llu (%.1f s of %.1f s) lost %.1f s dropped %llu failed %llu",
+		b->archive ? b->dest : "files",
+		(unsigned long long)__atomic_load_n(&b->written, __ATOMIC_RELAXED),
+		(double)__atomic_load_n(&b->samples, __ATOMIC_RELAXED) / b->samp_rate,
+		(double)__atomic_load_n(&b->measured, __ATOMIC_RELAXED) / b->samp_rate,
+		(double)__atomic_load_n(&b->lost, __ATOMIC_RELAXED) / b->samp_rate,
+		(unsigned long long)__atomic_load_n(&b->dropped, __ATOMIC_RELAXED),
+		(unsigned long long)__atomic_load_n(&b->failed, __ATOMIC_RELAXED));
+}
+
+void bursts_close(struct bursts *b)
+{
+	char report[512];
+	int i;
+
+	if (b->running) {
+		b->stop = 1;
+		sem_post(&b->wake);
+		pthread_join(b->detector, NULL);
+		pthread_mutex_lock(&b->lock);
+		b->finished = 1;
+		pthread_cond_broadcast(&b->more);
+		pthread_mutex_unlock(&b->lock);
+		for (i = 0; i < b->nworkers; i++) {
+			pthread_join(b->workers[i], NULL);}
+		b->running = 0;
+	}
+	bursts_report(b, report, sizeof(report));
+	fprintf(stderr, "Bursts %s\n", report);
+
+	if (b->archive) {
+		fflush(b->archive);
+		if (wave_append_cues(fileno(b->archive), b->archive_bytes, b->cues, b->ncues) < 0) {
+			fprintf(stderr, "WARNING: Failed to finish %s.\n", b->dest);}
+		fclose(b->archive);
+		b->archive = NULL;
+	}
+	if (b->index) {
+		fclose(b->index);
+		b->index = NULL;
+	}
+	free(b->cues);
+	b->cues = NULL;
+	pthread_mutex_destroy(&b->lock);
+	pthread_cond_destroy(&b->more);
+	sem_destroy(&b->wake);
+}
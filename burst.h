@@ -0,0 +1,200 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BURST_H
+#define __BURST_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "ring.h"
+#include "wave.h"
+
+/* bursts cut out of the ring, so only the transmissions are kept
+ *
+ * A detector thread measures the power of each frame of the ring
+ * against a noise floor it tracks while nothing is on the air.  A
+ * burst starts with a frame over the floor by the threshold and ends
+ * once the power has stayed under it for the hold time.  Each burst,
+ * padded on both sides, goes to a worker that reads it back out of
+ * the ring and writes it as its own WAVE file or into one archive of
+ * all of them, with a record in the index sidecar.
+ */
+
+#define BURST_MAGIC	"RWBU"
+#define BURST_VERSION	1
+#define BURST_SUFFIX	".bursts"
+#define BURST_ARCHIVE	"archive:"
+#define BURST_FRAME	256	/* samples per power measurement */
+#define BURST_JOBS	64	/* bursts waiting for a worker */
+#define BURST_WORKERS	8
+
+/* record flags */
+#define BURST_CUT	1	/* cut at the longest burst the ring holds,
+				 * the next one carries on from it */
+#define BURST_CLIPPED	2	/* the padding before went past the ring */
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t samp_rate;
+} __attribute__((packed)) burst_header_t;
+
+typedef struct {
+    uint64_t sample;	//stream sample of the first padded sample
+    uint64_t offset;	//byte offset in the archive, 0 for a file of its own
+    uint32_t length;	//samples, padding included
+    uint32_t frequency;	//center frequency plus the offset of the burst, Hz
+    float power;	//mean over the burst, dBFS
+    float floor;	//noise floor when it started, dBFS
+    int64_t time_ns;	//UTC time of the first sample
+    uint32_t flags;
+    uint32_t reserved;
+} __attribute__((packed)) burst_record_t;
+
+struct burst_job {
+	uint64_t sample;	/* first padded sample */
+	uint64_t ready;		/* ring sample the padding after ends at */
+	uint32_t length;	/* padded samples */
+	uint32_t pad;		/* samples of padding before the burst */
+	uint32_t core;		/* samples of the burst itself */
+	uint32_t frequency;	/* center frequency when it was detected */
+	float power, floor;
+	int64_t time_ns;
+	uint32_t flags;
+};
+
+struct bursts {
+	char dest[1024];	/* archive or per-burst file prefix */
+	struct ring *ring;
+	uint32_t samp_rate;
+	uint32_t frequency;	/* set atomically on retunes */
+	float threshold;	/* dB over the floor */
+	uint32_t hold;		/* quiet frames before a burst ends */
+	uint32_t pad;		/* samples each side */
+	uint32_t longest;	/* samples of the longest burst, padding included */
+	int nworkers;
+	int running;
+	volatile int stop;
+	sem_t wake;		/* posted after each ring push */
+	pthread_t detector;
+	pthread_t workers[BURST_WORKERS];
+	int cpu;
+	/* detector state */
+	uint64_t pos;		/* next ring sample to measure */
+	float floor;		/* dBFS */
+	int floor_set;
+	int active;
+	struct burst_job cur;
+	double sum;		/* power of the loud frames */
+	uint32_t loud, quiet;
+	/* closed bursts waiting for their padding after, then a worker */
+	struct burst_job waiting[BURST_JOBS];
+	int nwaiting;
+	pthread_mutex_t lock;
+	pthread_cond_t more;
+	struct burst_job jobs[BURST_JOBS];
+	int head, count;
+	int finished;		/* no more jobs are coming */
+	/* outputs, under lock */
+	FILE *index;
+	FILE *archive;		/* NULL for a file per burst */
+	uint64_t archive_bytes;
+	wave_cue_t *cues;
+	int ncues;
+	/* counters, read by other threads */
+	uint64_t written;
+	uint64_t samples;	/* padded samples written */
+	uint64_t measured;	/* samples the detector looked at */
+	uint64_t lost;		/* samples the detector fell too far behind for */
+	uint64_t dropped;	/* bursts with no room in the queue */
+	uint64_t failed;	/* bursts overwritten or not written */
+};
+
+/*!
+ * Set up burst extraction from a ring
+ *
+ * The spec is a destination, then optionally the threshold in dB over
+ * the noise floor, the hold time and the padding in milliseconds, and
+ * the number of writer threads, e.g. "archive:bursts.wav,12,10,2,2".
+ * A destination of "archive:path" writes every burst into one WAVE
+ * file with a cue region for each; anything else is a prefix, and
+ * each burst goes to prefix-<sample>.wav.  The index goes next to
+ * either, with BURST_SUFFIX appended.
+ *
+ * \param b the extractor
+ * \param spec destination[,threshold[,hold[,padding[,workers]]]]
+ * \param ring pushed to by the capture
+ * \param samp_rate in samples/second
+ * \param frequency center frequency in Hz
+ * \return 0 on success
+ */
+
+int bursts_open(struct bursts *b, const char *spec, struct ring *ring,
+	uint32_t samp_rate, uint32_t frequency);
+
+/*!
+ * Start the detector and the workers
+ *
+ * \param b the extractor
+ * \param cpu to pin the detector to, negative for none
+ * \return 0 on success; bursts_close() stops what did start either way
+ */
+
+int bursts_start(struct bursts *b, int cpu);
+
+/*!
+ * Wake the detector after samples are pushed to the ring
+ *
+ * \param b the extractor
+ */
+
+void bursts_notify(struct bursts *b);
+
+/*!
+ * Set the center frequency of the bursts to come
+ *
+ * \param b the extractor
+ * \param frequency in Hz
+ */
+
+void bursts_tune(struct bursts *b, uint32_t frequency);
+
+/*!
+ * Describe the extractor and its counters in one line
+ *
+ * \param b the extractor
+ * \param buf for the text
+ * \param len size of buf
+ */
+
+void bursts_report(struct bursts *b, char *buf, size_t len);
+
+/*!
+ * Write out the bursts already detected, stop the threads and close
+ * the outputs
+ *
+ * \param b the extractor
+ */
+
+void bursts_close(struct bursts *b);
+
+#endif
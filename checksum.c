@@ -0,0 +1,219 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+#if defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#endif
+
+#include "checksum.h"
+
+#define CRC32C_POLY	0x82f63b78	/* reversed Castagnoli polynomial */
+
+static uint32_t crc_table[8][256];
+static uint32_t (*crc_update)(uint32_t crc, const uint8_t *p, size_t len);
+static const char *crc_name;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/* slicing by 8, eight bytes per step through eight tables */
+static uint32_t crc32c_table(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while (len && ((uintptr_t)p & 7)) {
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+	while (len >= 8) {
+		uint32_t lo, hi;
+		memcpy(&lo, p, 4);
+		memcpy(&hi, p + 4, 4);
+		lo ^= crc;
+		crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+			crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+			crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+			crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);}
+	return crc;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while (len && ((uintptr_t)p & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		len--;
+	}
+#if defined(__x86_64__)
+	uint64_t crc64 = crc;
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc64 = _mm_crc32_u64(crc64, v);
+		p += 8;
+		len -= 8;
+	}
+	crc = (uint32_t)crc64;
+#endif
+	while (len >= 4) {
+		uint32_t v;
+		memcpy(&v, p, 4);
+		crc = _mm_crc32_u32(crc, v);
+		p += 4;
+		len -= 4;
+	}
+	while (len--) {
+		crc = _mm_crc32_u8(crc, *p++);}
+	return crc;
+}
+#endif
+
+#if defined(__aarch64__) && defined(__linux__)
+__attribute__((target("+crc")))
+static uint32_t crc32c_armv8(uint32_t crc, const uint8_t *p, size_t len)
+{
+	while (len && ((uintptr_t)p & 7)) {
+		crc = __crc32cb(crc, *p++);
+		len--;
+	}
+	while (len >= 8) {
+		uint64_t v;
+		memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+		p += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = __crc32cb(crc, *p++);}
+	return crc;
+}
+#endif
+
+static void crc32c_init(void)
+{
+	uint32_t crc;
+	int i, j;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++) {
+			crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;}
+		crc_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++) {
+		for (j = 1; j < 8; j++) {
+			crc_table[j][i] = crc_table[0][crc_table[j - 1][i] & 0xff] ^
+				(crc_table[j - 1][i] >> 8);}
+	}
+	crc_update = crc32c_table;
+	crc_name = "table";
+#if defined(__x86_64__) || defined(__i386__)
+	if (__builtin_cpu_supports("sse4.2")) {
+		crc_update = crc32c_sse42;
+		crc_name = "sse4.2";
+	}
+#endif
+#if defined(__aarch64__) && defined(__linux__)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		crc_update = crc32c_armv8;
+		crc_name = "armv8";
+	}
+#endif
+	/* RTL_WAVE_CRC=table checks the instructions against the table */
+	if (getenv("RTL_WAVE_CRC") && strcmp(getenv("RTL_WAVE_CRC"), "table") == 0) {
+		crc_update = crc32c_table;
+		crc_name = "table";
+	}
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	pthread_once(&crc_once, crc32c_init);
+	return ~crc_update(~crc, buf, len);
+}
+
+const char *crc32c_impl(void)
+{
+	pthread_once(&crc_once, crc32c_init);
+	return crc_name;
+}
+
+int checksum_open(struct checksum *c, const char *path, uint64_t data_offset)
+{
+	checksum_header_t h;
+
+	memset(c, 0, sizeof(*c));
+	c->file = fopen(path, "wb");
+	if (!c->file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CHECKSUM_MAGIC, 4);
+	h.version = CHECKSUM_VERSION;
+	h.record_size = sizeof(checksum_record_t);
+	h.data_offset = data_offset;
+	fwrite(&h, 1, sizeof(h), c->file);
+	fprintf(stderr, "Checksums: CRC32C (%s) in %s\n", crc32c_impl(), path);
+	return 0;
+}
+
+void checksum_record(struct checksum *c, uint64_t offset, uint32_t len, uint32_t crc)
+{
+	checksum_record_t r;
+	r.offset = offset;
+	r.len = len;
+	r.crc = crc;
+	/* one record per block, left to stdio buffering */
+	fwrite(&r, 1, sizeof(r), c->file);
+	c->count++;
+}
+
+void checksum_close(struct checksum *c)
+{
+	if (c->file && fclose(c->file) != 0) {
+		fprintf(stderr, "WARNING: Failed to write the checksums.\n");}
+	c->file = NULL;
+}
+
+int64_t checksum_read_header(int fd, checksum_header_t *h)
+{
+	struct stat st;
+	if (pread(fd, h, sizeof(*h), 0) != sizeof(*h)) {
+		return -1;}
+	if (memcmp(h->magic, CHECKSUM_MAGIC, 4) != 0 || h->version != CHECKSUM_VERSION) {
+		return -1;}
+	if (h->record_size < sizeof(checksum_record_t) || fstat(fd, &st) < 0) {
+		return -1;}
+	return (st.st_size - (int64_t)sizeof(*h)) / h->record_size;
+}
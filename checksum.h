@@ -0,0 +1,111 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CHECKSUM_H
+#define __CHECKSUM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* CRC32C of every block written, kept in a sidecar next to the capture
+ *
+ * A fixed size header is followed by one fixed size record per block
+ * in the order they were written, so a verifier can split the records
+ * between threads.
+ */
+
+#define CHECKSUM_MAGIC		"RWCK"
+#define CHECKSUM_VERSION	1
+#define CHECKSUM_SUFFIX		".crc"
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t data_offset;	//first sample byte in the capture
+} __attribute__((packed)) checksum_header_t;
+
+typedef struct {
+    uint64_t offset;	//byte offset of the block in the capture
+    uint32_t len;	//bytes in the block
+    uint32_t crc;	//CRC32C of those bytes
+} __attribute__((packed)) checksum_record_t;
+
+struct checksum {
+	FILE *file;
+	uint64_t count;
+};
+
+/*!
+ * CRC32C (Castagnoli) of a buffer
+ *
+ * Uses the SSE4.2 or ARMv8 CRC instructions when the cpu has them,
+ * and a table otherwise.
+ *
+ * \param crc of the bytes before, 0 to start
+ * \param buf bytes
+ * \param len number of bytes
+ * \return crc of everything so far
+ */
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/*!
+ * Name of the CRC32C code in use
+ *
+ * \return "sse4.2", "armv8" or "table"
+ */
+
+const char *crc32c_impl(void);
+
+/*!
+ * Create the checksum sidecar for a capture
+ *
+ * \param c the sidecar
+ * \param path of the sidecar
+ * \param data_offset of the first sample in the capture
+ * \return 0 on success
+ */
+
+int checksum_open(struct checksum *c, const char *path, uint64_t data_offset);
+
+/*!
+ * Record the checksum of a block written to the capture
+ *
+ * \param c the sidecar
+ * \param offset byte offset of the block in the capture
+ * \param len bytes in the block
+ * \param crc from crc32c()
+ */
+
+void checksum_record(struct checksum *c, uint64_t offset, uint32_t len, uint32_t crc);
+
+void checksum_close(struct checksum *c);
+
+/*!
+ * Read the header of a checksum sidecar
+ *
+ * \param fd of the sidecar
+ * \param h header to fill in
+ * \return number of records, -1 if this is not a checksum sidecar
+ */
+
+int64_t checksum_read_header(int fd, checksum_header_t *h);
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "control.h"
+
+#define CONTROL_POLL_MS 200	/* how often the thread checks for a stop */
+
+/* wait for fd to become readable, 0 on a timeout */
+static int control_wait(struct control *c, int fd)
+{
+	struct pollfd pfd;
+	int r;
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	do {
+		r = poll(&pfd, 1, CONTROL_POLL_MS);
+	} while (r < 0 && errno == EINTR);
+	return r;
+}
+
+/* a client that hangs up before its reply must not raise SIGPIPE,
+ * which stops the capture */
+static int control_reply(int fd, const char *reply)
+{
+	return send(fd, reply, strlen(reply), MSG_NOSIGNAL) < 0 ? -1 : 0;
+}
+
+static void control_client(struct control *c, int fd)
+{
+	char line[CONTROL_LINE], reply[CONTROL_LINE];
+	size_t used = 0;
+	ssize_t n;
+	char *end;
+
+	while (c->running) {
+		if (control_wait(c, fd) <= 0) {
+			continue;}
+		n = read(fd, line + used, sizeof(line) - 1 - used);
+		if (n <= 0) {
+			return;}
+		used += n;
+		line[used] = '\0';
+		while ((end = strchr(line, '\n')) != NULL) {
+			*end = '\0';
+			if (end > line && end[-1] == '\r') {
+				end[-1] = '\0';}
+			reply[0] = '\0';
+			c->handler(line, reply, sizeof(reply) - 1, c->ctx);
+			strcat(reply, "\n");
+			if (control_reply(fd, reply) < 0) {
+				return;}
+			used -= end + 1 - line;
+			memmove(line, end + 1, used + 1);
+		}
+		if (used == sizeof(line) - 1) {
+			control_reply(fd, "ERR line too long\n");
+			return;
+		}
+	}
+}
+
+static void *control_thread(void *arg)
+{
+	struct control *c = arg;
+	int fd;
+
+	while (c->running) {
+		if (control_wait(c, c->listener) <= 0) {
+			continue;}
+		fd = accept(c->listener, NULL, NULL);
+		if (fd < 0) {
+			continue;}
+		control_client(c, fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+int control_start(struct control *c, const char *path, control_handler handler, void *ctx)
+{
+	struct sockaddr_un addr;
+
+	memset(c, 0, sizeof(*c));
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Control socket path %s is too long.\n", path);
+		return -1;
+	}
+	strcpy(c->path, path);
+	c->handler = handler;
+	c->ctx = ctx;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	c->listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	unlink(path);
+	if (c->listener < 0 ||
+	    bind(c->listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(c->listener, 4) < 0) {
+		fprintf(stderr, "Failed to listen on %s: %s\n", path, strerror(errno));
+		if (c->listener >= 0) {
+			close(c->listener);}
+		return -1;
+	}
+	c->running = 1;
+	if (pthread_create(&c->thread, NULL, control_thread, c) != 0) {
+		fprintf(stderr, "Failed to start control thread.\n");
+		c->running = 0;
+		close(c->listener);
+		unlink(path);
+		return -1;
+	}
+	fprintf(stderr, "Listening for commands on %s\n", path);
+	return 0;
+}
+
+void control_stop(struct control *c)
+{
+	if (!c->running) {
+		return;}
+	c->running = 0;
+	pthread_join(c->thread, NULL);
+	close(c->listener);
+	unlink(c->path);
+}
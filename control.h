@@ -0,0 +1,63 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CONTROL_H
+#define __CONTROL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* a thread answering one line commands on a Unix stream socket,
+ * one client at a time, one reply line per command */
+
+#define CONTROL_LINE 1024
+
+typedef void (*control_handler)(char *line, char *reply, size_t len, void *ctx);
+
+struct control {
+	int listener;
+	pthread_t thread;
+	volatile int running;
+	char path[108];
+	control_handler handler;
+	void *ctx;
+};
+
+/*!
+ * Listen on a socket path and start the control thread
+ *
+ * A stale socket left at the path is replaced.
+ *
+ * \param c the control socket
+ * \param path of the socket
+ * \param handler called from the control thread for each command,
+ *        without the line ending, to fill in the reply
+ * \param ctx passed to the handler
+ * \return 0 on success
+ */
+
+int control_start(struct control *c, const char *path, control_handler handler, void *ctx);
+
+/*!
+ * Stop the control thread and remove the socket
+ *
+ * \param c the control socket
+ */
+
+void control_stop(struct control *c);
+
+#endif
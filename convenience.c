@@ -19,12 +19,20 @@
  * todo: use strtol for more flexible int parsing
  * */
 
+#ifndef _WIN32
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
 #else
 #include <windows.h>
 #include <fcntl.h>
@@ -63,6 +71,33 @@ double atofs(char *s)
 	return atof(s);
 }
 
+double atofb(char *s)
+/* binary suffixes, for sizes in bytes */
+{
+	char last;
+	int len;
+	double suff = 1.0;
+	len = strlen(s);
+	last = s[len-1];
+	s[len-1] = '\0';
+	switch (last) {
+		case 'g':
+		case 'G':
+			suff *= 1024;
+		case 'm':
+		case 'M':
+			suff *= 1024;
+		case 'k':
+		case 'K':
+			suff *= 1024;
+			suff *= atof(s);
+			s[len-1] = last;
+			return suff;
+	}
+	s[len-1] = last;
+	return atof(s);
+}
+
 double atoft(char *s)
 /* time suffixes, returns seconds */
 {
@@ -109,6 +144,53 @@ double atofp(char *s)
 	return atof(s);
 }
 
+/* gain lists of the open devices, queried once per device */
+#define GAIN_TABLES 16
+static struct {
+	rtlsdr_dev_t *dev;
+	int count;
+	int *gains;
+} gain_tables[GAIN_TABLES];
+
+static int gain_table(rtlsdr_dev_t *dev, int **gains)
+{
+	int i, slot = -1;
+	for (i=0; i<GAIN_TABLES; i++) {
+		if (gain_tables[i].dev == dev) {
+			*gains = gain_tables[i].gains;
+			return gain_tables[i].count;
+		}
+		if (slot < 0 && !gain_tables[i].dev) {
+			slot = i;}
+	}
+	if (slot < 0) {
+		slot = 0;
+		free(gain_tables[slot].gains);
+	}
+	gain_tables[slot].dev = dev;
+	gain_tables[slot].gains = NULL;
+	gain_tables[slot].count = rtlsdr_get_tuner_gains(dev, NULL);
+	if (gain_tables[slot].count > 0) {
+		gain_tables[slot].gains = malloc(sizeof(int) * gain_tables[slot].count);
+		gain_tables[slot].count = rtlsdr_get_tuner_gains(dev, gain_tables[slot].gains);
+	}
+	*gains = gain_tables[slot].gains;
+	return gain_tables[slot].count;
+}
+
+void forget_gains(rtlsdr_dev_t *dev)
+{
+	int i;
+	for (i=0; i<GAIN_TABLES; i++) {
+		if (gain_tables[i].dev == dev) {
+			free(gain_tables[i].gains);
+			gain_tables[i].gains = NULL;
+			gain_tables[i].count = 0;
+			gain_tables[i].dev = NULL;
+		}
+	}
+}
+
 int nearest_gain(rtlsdr_dev_t *dev, int target_gain)
 {
 	int i, r, err1, err2, count, nearest;
@@ -118,12 +200,10 @@ int nearest_gain(rtlsdr_dev_t *dev, int target_gain)
 		fprintf(stderr, "WARNING: Failed to enable manual gain.\n");
 		return r;
 	}
-	count = rtlsdr_get_tuner_gains(dev, NULL);
+	count = gain_table(dev, &gains);
 	if (count <= 0) {
 		return 0;
 	}
-	gains = malloc(sizeof(int) * count);
-	count = rtlsdr_get_tuner_gains(dev, gains);
 	nearest = gains[0];
 	for (i=0; i<count; i++) {
 		err1 = abs(target_gain - nearest);
@@ -132,7 +212,6 @@ int nearest_gain(rtlsdr_dev_t *dev, int target_gain)
 			nearest = gains[i];
 		}
 	}
-	free(gains);
 	return nearest;
 }
 
@@ -241,64 +320,151 @@ int verbose_reset_buffer(rtlsdr_dev_t *dev)
 	return r;
 }
 
+/* the usb strings of every device, read once since each read opens the device */
+static struct device_strings {
+	char vendor[256], product[256], serial[256];
+} *devices;
+static int device_count = -1;
+
+static int device_scan(void)
+{
+	int i;
+	if (device_count >= 0) {
+		return device_count;}
+	device_count = rtlsdr_get_device_count();
+	devices = calloc(device_count ? device_count : 1, sizeof(struct device_strings));
+	for (i = 0; i < device_count; i++) {
+		rtlsdr_get_device_usb_strings(i, devices[i].vendor,
+			devices[i].product, devices[i].serial);}
+	return device_count;
+}
+
+const char *device_serial(int index)
+{
+	if (index < 0 || index >= device_scan()) {
+		return "";}
+	return devices[index].serial;
+}
+
+static int device_found(int device)
+{
+	fprintf(stderr, "Using device %d: %s\n",
+		device, rtlsdr_get_device_name((uint32_t)device));
+	return device;
+}
+
 int verbose_device_search(char *s)
 {
-	int i, device_count, device, offset;
+	int i, device, offset, len = strlen(s);
 	char *s2;
-	char vendor[256], product[256], serial[256];
-	device_count = rtlsdr_get_device_count();
-	if (!device_count) {
+	if (!device_scan()) {
 		fprintf(stderr, "No supported devices found.\n");
 		return -1;
 	}
 	fprintf(stderr, "Found %d device(s):\n", device_count);
 	for (i = 0; i < device_count; i++) {
-		rtlsdr_get_device_usb_strings(i, vendor, product, serial);
-		fprintf(stderr, "  %d:  %s, %s, SN: %s\n", i, vendor, product, serial);
+		fprintf(stderr, "  %d:  %s, %s, SN: %s\n", i, devices[i].vendor,
+			devices[i].product, devices[i].serial);
 	}
 	fprintf(stderr, "\n");
 	/* does string look like raw id number */
 	device = (int)strtol(s, &s2, 0);
 	if (s2[0] == '\0' && device >= 0 && device < device_count) {
-		fprintf(stderr, "Using device %d: %s\n",
-			device, rtlsdr_get_device_name((uint32_t)device));
-		return device;
+		return device_found(device);
 	}
 	/* does string exact match a serial */
 	for (i = 0; i < device_count; i++) {
-		rtlsdr_get_device_usb_strings(i, vendor, product, serial);
-		if (strcmp(s, serial) != 0) {
-			continue;}
-		device = i;
-		fprintf(stderr, "Using device %d: %s\n",
-			device, rtlsdr_get_device_name((uint32_t)device));
-		return device;
+		if (strcmp(s, devices[i].serial) == 0) {
+			return device_found(i);}
 	}
 	/* does string prefix match a serial */
 	for (i = 0; i < device_count; i++) {
-		rtlsdr_get_device_usb_strings(i, vendor, product, serial);
-		if (strncmp(s, serial, strlen(s)) != 0) {
-			continue;}
-		device = i;
-		fprintf(stderr, "Using device %d: %s\n",
-			device, rtlsdr_get_device_name((uint32_t)device));
-		return device;
+		if (strncmp(s, devices[i].serial, len) == 0) {
+			return device_found(i);}
 	}
 	/* does string suffix match a serial */
 	for (i = 0; i < device_count; i++) {
-		rtlsdr_get_device_usb_strings(i, vendor, product, serial);
-		offset = strlen(serial) - strlen(s);
+		offset = strlen(devices[i].serial) - len;
 		if (offset < 0) {
 			continue;}
-		if (strncmp(s, serial+offset, strlen(s)) != 0) {
-			continue;}
-		device = i;
-		fprintf(stderr, "Using device %d: %s\n",
-			device, rtlsdr_get_device_name((uint32_t)device));
-		return device;
+		if (strncmp(s, devices[i].serial+offset, len) == 0) {
+			return device_found(i);}
 	}
 	fprintf(stderr, "No matching devices found.\n");
 	return -1;
 }
 
+int verbose_realtime(int priority)
+{
+#ifndef _WIN32
+	int r;
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+	if (r != 0) {
+		fprintf(stderr, "WARNING: Failed to set SCHED_FIFO priority %d (%s).\n",
+			priority, strerror(r));
+		return -r;
+	}
+	fprintf(stderr, "Real-time priority set to %d.\n", priority);
+	return 0;
+#else
+	fprintf(stderr, "WARNING: Real-time priority not supported.\n");
+	return -1;
+#endif
+}
+
+int verbose_cpu_affinity(const char *name, int cpu)
+{
+#if !defined(_WIN32) && defined(__linux__)
+	int r;
+	cpu_set_t set;
+	if (cpu < 0) {
+		return 0;}
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (r != 0) {
+		fprintf(stderr, "WARNING: Failed to pin %s thread to cpu %d (%s).\n",
+			name, cpu, strerror(r));
+		return -r;
+	}
+	fprintf(stderr, "Pinned %s thread to cpu %d.\n", name, cpu);
+	return 0;
+#else
+	if (cpu < 0) {
+		return 0;}
+	fprintf(stderr, "WARNING: CPU affinity not supported.\n");
+	return -1;
+#endif
+}
+
+int verbose_mlockall(void)
+{
+#ifndef _WIN32
+	int r;
+	r = mlockall(MCL_CURRENT | MCL_FUTURE);
+	if (r != 0) {
+		fprintf(stderr, "WARNING: Failed to lock memory (%s).\n", strerror(errno));
+		return -errno;
+	}
+	fprintf(stderr, "Memory locked.\n");
+	return 0;
+#else
+	fprintf(stderr, "WARNING: Memory locking not supported.\n");
+	return -1;
+#endif
+}
+
+void prefault(void *buf, size_t len)
+{
+	size_t i;
+	volatile uint8_t *p = buf;
+	for (i = 0; i < len; i += 4096) {
+		p[i] = 0;}
+	if (len) {
+		p[len-1] = 0;}
+}
+
 // vim: tabstop=8:softtabstop=8:shiftwidth=8:noexpandtab
@@ -26,6 +26,15 @@
 
 double atofs(char *s);
 
+/*!
+ * Convert binary suffixes (k, M, G as powers of 1024) to double
+ *
+ * \param s a string to be parsed
+ * \return bytes as double
+ */
+
+double atofb(char *s);
+
 /*!
  * Convert time suffixes (s, m, h) to double
  *
@@ -47,6 +56,8 @@ double atofp(char *s);
 /*!
  * Find nearest supported gain
  *
+ * The gain list is read once per device handle and kept.
+ *
  * \param dev the device handle given by rtlsdr_open()
  * \param target_gain in tenths of a dB
  * \return 0 on success
@@ -54,6 +65,17 @@ double atofp(char *s);
 
 int nearest_gain(rtlsdr_dev_t *dev, int target_gain);
 
+/*!
+ * Drop the gain list kept for a device handle
+ *
+ * Call it before rtlsdr_close(), a handle opened later at the same
+ * address may be another tuner.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ */
+
+void forget_gains(rtlsdr_dev_t *dev);
+
 /*!
  * Set device frequency and report status on stderr
  *
@@ -134,9 +156,56 @@ int verbose_reset_buffer(rtlsdr_dev_t *dev);
 /*!
  * Find the closest matching device.
  *
+ * The usb strings of all devices are read once and reused by later
+ * searches.
+ *
  * \param s a string to be parsed
  * \return dev_index int, -1 on error
  */
 
 int verbose_device_search(char *s);
 
+/*!
+ * Serial number of a device, from the list read by the first search
+ *
+ * \param index of the device
+ * \return the serial, empty for an unknown index
+ */
+
+const char *device_serial(int index);
+
+/*!
+ * Give the calling thread SCHED_FIFO priority and report status on stderr
+ *
+ * \param priority SCHED_FIFO priority, 1 to 99
+ * \return 0 on success
+ */
+
+int verbose_realtime(int priority);
+
+/*!
+ * Pin the calling thread to one cpu and report status on stderr
+ *
+ * \param name of the thread for the report
+ * \param cpu index, negative to leave the thread unpinned
+ * \return 0 on success
+ */
+
+int verbose_cpu_affinity(const char *name, int cpu);
+
+/*!
+ * Lock current and future memory and report status on stderr
+ *
+ * \return 0 on success
+ */
+
+int verbose_mlockall(void);
+
+/*!
+ * Touch every page of a buffer so it does not fault on first use
+ *
+ * \param buf start of the buffer
+ * \param len length in bytes
+ */
+
+void prefault(void *buf, size_t len);
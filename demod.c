@@ -0,0 +1,339 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "dsp.h"
+#include "demod.h"
+
+#define L	DEMOD_LANES
+
+/* a lane anywhere in a chunk, whatever its alignment */
+typedef float demod_lane_u __attribute__((vector_size(L * sizeof(float)), aligned(4)));
+
+static const struct {
+	const char *name;
+	uint32_t if_rate;	/* lowest */
+	uint32_t audio_rate;	/* nearest */
+	float audio_bw;		/* Hz kept by the audio filter */
+	float deviation;	/* FM deviation to full scale, Hz */
+	float deemph_us;	/* de-emphasis time constant, 0 for none */
+} modes[DEMOD_MODES] = {
+	{"am", 32000, 16000, 4500, 0, 0},
+	{"nbfm", 32000, 16000, 4000, 5000, 0},
+	{"wbfm", 200000, 48000, 16000, 75000, 75},
+};
+
+/* a number with an optional k or M suffix */
+static double demod_number(const char *s)
+{
+	char *end;
+	double v = strtod(s, &end);
+	switch (*end) {
+	case 'k': case 'K':
+		return v * 1e3;
+	case 'M':
+		return v * 1e6;
+	}
+	return v;
+}
+
+static int demod_fir_init(struct demod_fir *f, int decim, int ntaps, float cutoff)
+{
+	memset(f, 0, sizeof(*f));
+	f->decim = decim;
+	/* a stage that does not decimate only passes the samples on */
+	f->ntaps = decim > 1 ? ntaps | 1 : 1;
+	f->taps = malloc(f->ntaps * sizeof(float));
+	f->buf = calloc(f->ntaps + DEMOD_CHUNK + decim, sizeof(float));
+	if (!f->taps || !f->buf) {
+		return -1;}
+	if (f->ntaps > 1) {
+		fir_lowpass(f->taps, f->ntaps, cutoff);
+	} else {
+		f->taps[0] = 1;}
+	/* the stream starts from silence */
+	f->fill = f->ntaps - 1;
+	return 0;
+}
+
+/* push n samples through a stage, out may be in */
+static uint32_t demod_fir_run(struct demod_fir *f, const float *in, uint32_t n, float *out)
+{
+	uint32_t n_out, used;
+
+	memcpy(f->buf + f->fill, in, n * sizeof(float));
+	f->fill += n;
+	if (f->fill < (uint32_t)f->ntaps) {
+		return 0;}
+	n_out = (f->fill - f->ntaps) / f->decim + 1;
+	fir_decimate(f->buf, out, n_out, f->taps, f->ntaps, f->decim);
+	used = n_out * f->decim;
+	f->fill -= used;
+	memmove(f->buf, f->buf + used, f->fill * sizeof(float));
+	return n_out;
+}
+
+static void demod_fir_free(struct demod_fir *f)
+{
+	free(f->taps);
+	free(f->buf);
+	f->taps = f->buf = NULL;
+}
+
+const char *demod_name(enum demod_mode mode)
+{
+	return modes[mode].name;
+}
+
+const char *demod_dest(const char *dest)
+{
+	const char *rest;
+	size_t len;
+	int m;
+
+	for (m = 0; m < DEMOD_MODES; m++) {
+		len = strlen(modes[m].name);
+		if (strncmp(dest, modes[m].name, len) != 0 ||
+		    (dest[len] != ':' && dest[len] != '@')) {
+			continue;}
+		rest = strchr(dest + len, ':');
+		return rest ? rest + 1 : NULL;
+	}
+	return NULL;
+}
+
+int demod_open(struct demod *d, const char *spec, uint32_t samp_rate)
+{
+	uint32_t total, coarse, channel, audio;
+	const char *at;
+	size_t len;
+	int m;
+
+	memset(d, 0, sizeof(*d));
+	len = strcspn(spec, "@:");
+	for (m = 0; m < DEMOD_MODES; m++) {
+		if (strlen(modes[m].name) == len && strncmp(spec, modes[m].name, len) == 0) {
+			break;}
+	}
+	if (m == DEMOD_MODES) {
+		fprintf(stderr, "Demodulator %.*s is not am, nbfm or wbfm.\n", (int)len, spec);
+		return -1;
+	}
+	if (samp_rate < modes[m].if_rate) {
+		fprintf(stderr, "Demodulator %s needs at least %u samples/second.\n",
+			modes[m].name, modes[m].if_rate);
+		return -1;
+	}
+	d->mode = m;
+	d->samp_rate = samp_rate;
+	at = spec[len] == '@' ? spec + len + 1 : NULL;
+	d->offset = at ? demod_number(at) : 0;
+
+	/* the coarse stage takes most of the decimation with a short
+	 * filter, leaving four times the IF rate for a sharp channel
+	 * filter */
+	total = samp_rate / modes[m].if_rate;
+	channel = total >= 8 ? 4 : total;
+	coarse = total / channel;
+	d->if_rate = samp_rate / (coarse * channel);
+	audio = (uint32_t)lrint((double)d->if_rate / modes[m].audio_rate);
+	if (!audio) {
+		audio = 1;}
+	d->audio_rate = d->if_rate / audio;
+
+	if (demod_fir_init(&d->coarse_i, coarse, 8 * coarse + 1, 0.5f / coarse) < 0 ||
+	    demod_fir_init(&d->coarse_q, coarse, 8 * coarse + 1, 0.5f / coarse) < 0 ||
+	    demod_fir_init(&d->channel_i, channel, 16 * channel + 1, 0.5f / channel) < 0 ||
+	    demod_fir_init(&d->channel_q, channel, 16 * channel + 1, 0.5f / channel) < 0 ||
+	    demod_fir_init(&d->audio, audio, 32 * audio + 1, modes[m].audio_bw / d->if_rate) < 0) {
+		demod_free(d);
+		return -1;
+	}
+	if (modes[m].deviation) {
+		d->gain = d->if_rate / (2 * M_PI * modes[m].deviation);}
+	if (modes[m].deemph_us) {
+		d->deemph_a = expf(-1e6f / (d->audio_rate * modes[m].deemph_us));}
+
+	d->i = malloc(DEMOD_CHUNK * sizeof(float));
+	d->q = malloc(DEMOD_CHUNK * sizeof(float));
+	/* the IF sample before the chunk goes first, then room for a
+	 * partial lane */
+	d->fi = calloc(DEMOD_CHUNK + L + 1, sizeof(float));
+	d->fq = calloc(DEMOD_CHUNK + L + 1, sizeof(float));
+	d->a = malloc((DEMOD_CHUNK + L) * sizeof(float));
+	if (!d->i || !d->q || !d->fi || !d->fq || !d->a) {
+		demod_free(d);
+		return -1;
+	}
+	return 0;
+}
+
+/* mix the chunk down by the offset, each lane turning by L steps */
+static void demod_mix(struct demod *d, float *i, float *q, uint32_t n)
+{
+	double step = -d->offset / d->samp_rate, c;
+	float sr = (float)cos(2 * M_PI * step * L), si = (float)sin(2 * M_PI * step * L);
+	demod_lane pr, pi, vi, vq, t;
+	uint32_t m;
+	int k;
+
+	for (k = 0; k < L; k++) {
+		c = d->phase + step * k;
+		pr[k] = (float)cos(2 * M_PI * (c - floor(c)));
+		pi[k] = (float)sin(2 * M_PI * (c - floor(c)));
+	}
+	for (m = 0; m + L <= n; m += L) {
+		vi = *(demod_lane_u *)(i + m);
+		vq = *(demod_lane_u *)(q + m);
+		*(demod_lane_u *)(i + m) = vi * pr - vq * pi;
+		*(demod_lane_u *)(q + m) = vi * pi + vq * pr;
+		t = pr * sr - pi * si;
+		pi = pr * si + pi * sr;
+		pr = t;
+	}
+	for (k = 0; m + k < n; k++) {
+		t[0] = i[m + k];
+		i[m + k] = t[0] * pr[k] - q[m + k] * pi[k];
+		q[m + k] = t[0] * pi[k] + q[m + k] * pr[k];
+	}
+	c = d->phase + step * n;
+	d->phase = c - floor(c);
+}
+
+static inline demod_lane demod_select(demod_ilane mask, demod_lane a, demod_lane b)
+{
+	return (demod_lane)(((demod_ilane)a & mask) | ((demod_ilane)b & ~mask));
+}
+
+/* atan2 to about 1e-5 radians, an odd polynomial in the ratio of the
+ * smaller to the larger magnitude folded into each octant */
+static inline demod_lane demod_atan2(demod_lane y, demod_lane x)
+{
+	const demod_ilane sign = (demod_ilane){0} | INT32_MIN;
+	demod_lane ax = (demod_lane)((demod_ilane)x & ~sign);
+	demod_lane ay = (demod_lane)((demod_ilane)y & ~sign);
+	demod_ilane steep = ay > ax;
+	demod_lane a, s, r;
+
+	a = demod_select(steep, ax, ay) / (demod_select(steep, ay, ax) + 1e-30f);
+	s = a * a;
+	r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+	r = demod_select(steep, (float)M_PI_2 - r, r);
+	r = demod_select(x < 0, (float)M_PI - r, r);
+	return (demod_lane)((demod_ilane)r | ((demod_ilane)y & sign));
+}
+
+/* phase step between IF samples, fi[0] and fq[0] being the last
+ * sample of the chunk before */
+static void demod_fm(struct demod *d, uint32_t n)
+{
+	const float *fi = d->fi, *fq = d->fq;
+	demod_lane ci, cq, pi, pq;
+	uint32_t m;
+
+	for (m = 0; m < n; m += L) {
+		pi = *(demod_lane_u *)(fi + m);
+		pq = *(demod_lane_u *)(fq + m);
+		ci = *(demod_lane_u *)(fi + m + 1);
+		cq = *(demod_lane_u *)(fq + m + 1);
+		*(demod_lane_u *)(d->a + m) = d->gain *
+			demod_atan2(cq * pi - ci * pq, ci * pi + cq * pq);
+	}
+}
+
+/* envelope against the carrier level, averaged over 50 ms */
+static void demod_am(struct demod *d, uint32_t n)
+{
+	float alpha = 20.0f / d->if_rate, env;
+	uint32_t k;
+
+	for (k = 0; k < n; k++) {
+		env = sqrtf(d->fi[k + 1] * d->fi[k + 1] + d->fq[k + 1] * d->fq[k + 1]);
+		if (!d->carrier) {
+			d->carrier = env;}
+		d->carrier += (env - d->carrier) * alpha;
+		d->a[k] = d->carrier > 0 ? (env - d->carrier) / d->carrier : 0;
+	}
+}
+
+uint32_t demod_block(struct demod *d, const uint8_t *buf, uint32_t len, int16_t **audio)
+{
+	uint32_t samples = len / 2, done = 0, total = 0, n, n1, n2, n3, k;
+	uint32_t need = samples / (d->coarse_i.decim * d->channel_i.decim * d->audio.decim) + 4;
+	float x;
+
+	if (need > d->out_len) {
+		free(d->out);
+		d->out = malloc(need * sizeof(int16_t));
+		d->out_len = d->out ? need : 0;
+		if (!d->out) {
+			return 0;}
+	}
+	while (done < samples) {
+		n = samples - done < DEMOD_CHUNK ? samples - done : DEMOD_CHUNK;
+		deinterleave_s8((const int8_t *)buf + 2 * done, d->i, d->q, n);
+		done += n;
+		if (d->offset) {
+			demod_mix(d, d->i, d->q, n);}
+		n1 = demod_fir_run(&d->coarse_i, d->i, n, d->i);
+		demod_fir_run(&d->coarse_q, d->q, n, d->q);
+		n2 = demod_fir_run(&d->channel_i, d->i, n1, d->fi + 1);
+		demod_fir_run(&d->channel_q, d->q, n1, d->fq + 1);
+		if (!n2) {
+			continue;}
+		if (d->mode == DEMOD_AM) {
+			demod_am(d, n2);
+		} else {
+			demod_fm(d, n2);}
+		d->fi[0] = d->fi[n2];
+		d->fq[0] = d->fq[n2];
+
+		n3 = demod_fir_run(&d->audio, d->a, n2, d->a);
+		for (k = 0; k < n3; k++) {
+			x = d->a[k];
+			if (d->deemph_a) {
+				x = d->deemph = d->deemph_a * d->deemph + (1 - d->deemph_a) * x;}
+			x = x * 32767;
+			d->out[total + k] = (int16_t)lrintf(x < -32768 ? -32768 : (x > 32767 ? 32767 : x));
+		}
+		total += n3;
+	}
+	*audio = d->out;
+	return total;
+}
+
+void demod_free(struct demod *d)
+{
+	demod_fir_free(&d->coarse_i);
+	demod_fir_free(&d->coarse_q);
+	demod_fir_free(&d->channel_i);
+	demod_fir_free(&d->channel_q);
+	demod_fir_free(&d->audio);
+	free(d->i);
+	free(d->q);
+	free(d->fi);
+	free(d->fq);
+	free(d->a);
+	free(d->out);
+	d->i = d->q = d->fi = d->fq = d->a = NULL;
+	d->out = NULL;
+	d->out_len = 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DEMOD_H
+#define __DEMOD_H
+
+#include <stdint.h>
+
+/* AM, narrow and wide FM demodulators, from converted I/Q blocks to
+ * 16 bit mono audio
+ *
+ * A DDC mixes the station at an offset from the center down to 0 Hz
+ * and brings it to the IF rate of the mode in two filter and
+ * decimate stages, a short one over the full rate and a sharper one
+ * to the channel.  The envelope or the FM discriminator, an atan2
+ * approximation, runs over the IF samples, and a last stage filters
+ * and decimates the audio.  Every rate is the input rate divided by
+ * whole numbers, so the audio rate is close to but not exactly the
+ * rate asked for.  The mixer and the discriminator run DEMOD_LANES
+ * samples at a time.
+ */
+
+#define DEMOD_LANES	4
+#define DEMOD_CHUNK	4096	/* input samples worked on at a time */
+
+typedef float demod_lane __attribute__((vector_size(DEMOD_LANES * sizeof(float))));
+typedef int32_t demod_ilane __attribute__((vector_size(DEMOD_LANES * sizeof(int32_t))));
+
+enum demod_mode {DEMOD_AM, DEMOD_NBFM, DEMOD_WBFM, DEMOD_MODES};
+
+/* a streaming filter and decimate stage */
+struct demod_fir {
+	int decim;
+	int ntaps;
+	float *taps;
+	float *buf;		/* history, then the samples not yet used */
+	uint32_t fill;
+};
+
+struct demod {
+	enum demod_mode mode;
+	uint32_t samp_rate;
+	double offset;		/* Hz of the station from the center */
+	uint32_t if_rate;
+	uint32_t audio_rate;
+	double phase;		/* of the mixer, in cycles */
+	struct demod_fir coarse_i, coarse_q;
+	struct demod_fir channel_i, channel_q;
+	struct demod_fir audio;
+	float gain;		/* discriminator radians to full scale */
+	float carrier;		/* AM carrier level */
+	float deemph, deemph_a;	/* WBFM de-emphasis state and coefficient */
+	/* per chunk */
+	float *i, *q, *fi, *fq, *a;
+	int16_t *out;
+	uint32_t out_len;
+};
+
+/*!
+ * Strip the demodulator from a sink destination
+ *
+ * \param dest e.g. "wbfm@-400k:fm.wav"
+ * \return what follows the demodulator, "fm.wav", or NULL if dest
+ *         does not start with one
+ */
+
+const char *demod_dest(const char *dest);
+
+/*!
+ * Set up a demodulator
+ *
+ * \param d the demodulator
+ * \param spec am, nbfm or wbfm, then optionally @ and the offset of
+ *        the station from the center, e.g. "nbfm@12.5k"
+ * \param samp_rate input samples/second
+ * \return 0 on success, -1 for a bad spec or a rate too low for the mode
+ */
+
+int demod_open(struct demod *d, const char *spec, uint32_t samp_rate);
+
+/*!
+ * Demodulate a block
+ *
+ * \param d the demodulator
+ * \param buf converted interleaved signed 8 bit I/Q samples
+ * \param len number of bytes
+ * \param audio set to the audio samples, valid until the next call
+ * \return number of audio samples
+ */
+
+uint32_t demod_block(struct demod *d, const uint8_t *buf, uint32_t len, int16_t **audio);
+
+/*!
+ * Name of a mode
+ *
+ * \param mode of a demodulator
+ * \return "am", "nbfm" or "wbfm"
+ */
+
+const char *demod_name(enum demod_mode mode);
+
+void demod_free(struct demod *d);
+
+#endif
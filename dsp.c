@@ -0,0 +1,198 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+
+#include "dsp.h"
+
+void convert_u8(uint8_t *buf, uint32_t len)
+{
+	for (uint32_t n=0; n<len; n++) buf[n] = buf[n] - 128;
+}
+
+void convert_copy(uint8_t *dst, const uint8_t *src, uint32_t len)
+{
+	for (uint32_t n=0; n<len; n++) dst[n] = src[n] - 128;
+}
+
+void stats_update(struct iq_stats *st, const uint8_t *buf, uint32_t len)
+{
+	float ipeak = st->ipeak, qpeak = st->qpeak;
+	float iavg = st->iavg, qavg = st->qavg;
+
+	for (uint32_t i=0; i + 1 < len; i += 2)
+	{
+		float ival = (float) (buf[i] - 128) / 128;
+		float qval = (float) (buf[i+1] - 128) / 128;
+		ival = ival * ival;
+		qval = qval * qval;
+		iavg += ival;
+		qavg += qval;
+		if (ival > ipeak) ipeak = ival;
+		if (qval > qpeak) qpeak = qval;
+	}
+
+	st->ipeak = ipeak;
+	st->qpeak = qpeak;
+	st->iavg = iavg;
+	st->qavg = qavg;
+	st->count += len / 2;
+}
+
+void stats_report(struct iq_stats *st, FILE *file)
+{
+	float iavg = st->iavg / st->count;
+	float qavg = st->qavg / st->count;
+
+	fprintf(file, "PEAK %5.1f | %5.1f dBFS   PAR %4.1f | %4.1f dB\n",
+		db(st->ipeak), db(st->qpeak), db(st->ipeak / iavg), db(st->qpeak / qavg));
+	memset(st, 0, sizeof(*st));
+}
+
+float mean_power(const uint8_t *buf, uint32_t len)
+{
+	const int8_t *s = (const int8_t *)buf;
+	uint64_t sum = 0;
+	for (uint32_t n=0; n<len; n++) sum += s[n] * s[n];
+	if (len < 2)
+		return 0;
+	return (float)sum / (len / 2) / (128 * 128);
+}
+
+float block_power(const uint8_t *buf, uint32_t len)
+{
+	float p = mean_power(buf, len);
+	if (!p)
+		return -100;
+	return 10 * log10f(p);
+}
+
+void widen_s8(const int8_t *in, void *out, uint32_t len, int bits)
+{
+	int16_t *s16 = out;
+	float *f32 = out;
+	if (bits == 16) {
+		for (uint32_t n=0; n<len; n++) s16[n] = in[n] * 256;
+	} else {
+		for (uint32_t n=0; n<len; n++) f32[n] = in[n] * (1.0f / 128);
+	}
+}
+
+void deinterleave_s8(const int8_t *in, float *i, float *q, uint32_t n)
+{
+	for (uint32_t k=0; k<n; k++) {
+		i[k] = in[2*k] * (1.0f / 128);
+		q[k] = in[2*k+1] * (1.0f / 128);
+	}
+}
+
+void deinterleave_s16(const int16_t *in, float *i, float *q, uint32_t n)
+{
+	for (uint32_t k=0; k<n; k++) {
+		i[k] = in[2*k] * (1.0f / 32768);
+		q[k] = in[2*k+1] * (1.0f / 32768);
+	}
+}
+
+static float clampf(float x, float lo, float hi)
+{
+	return x < lo ? lo : (x > hi ? hi : x);
+}
+
+void interleave(const float *i, const float *q, void *out, uint32_t n, int bits)
+{
+	uint32_t k;
+	int8_t *s8 = out;
+	int16_t *s16 = out;
+	float *f32 = out;
+
+	switch (bits) {
+	case 8:
+		for (k=0; k<n; k++) {
+			s8[2*k] = (int8_t)lrintf(clampf(i[k] * 128, -128, 127));
+			s8[2*k+1] = (int8_t)lrintf(clampf(q[k] * 128, -128, 127));
+		}
+		break;
+	case 16:
+		for (k=0; k<n; k++) {
+			s16[2*k] = (int16_t)lrintf(clampf(i[k] * 32768, -32768, 32767));
+			s16[2*k+1] = (int16_t)lrintf(clampf(q[k] * 32768, -32768, 32767));
+		}
+		break;
+	default:
+		for (k=0; k<n; k++) {
+			f32[2*k] = i[k];
+			f32[2*k+1] = q[k];
+		}
+		break;
+	}
+}
+
+void remove_dc(float *x, uint32_t n, float dc)
+{
+	uint32_t k;
+	for (k=0; k<n; k++) x[k] -= dc;
+}
+
+void fir_lowpass(float *taps, int ntaps, float cutoff)
+{
+	int k;
+	double sum = 0, m = (ntaps - 1) / 2.0;
+	for (k=0; k<ntaps; k++) {
+		double t = k - m;
+		double sinc = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+		/* blackman window */
+		double w = 0.42 - 0.5 * cos(2 * M_PI * k / (ntaps - 1))
+			+ 0.08 * cos(4 * M_PI * k / (ntaps - 1));
+		taps[k] = sinc * w;
+		sum += taps[k];
+	}
+	for (k=0; k<ntaps; k++) taps[k] /= sum;
+}
+
+float fir_dot(const float *x, const float *taps, int ntaps)
+{
+	/* independent partial sums let the compiler vectorize */
+	float a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	int j = 0;
+	for (; j + 4 <= ntaps; j += 4) {
+		a0 += taps[j] * x[j];
+		a1 += taps[j+1] * x[j+1];
+		a2 += taps[j+2] * x[j+2];
+		a3 += taps[j+3] * x[j+3];
+	}
+	for (; j < ntaps; j++) a0 += taps[j] * x[j];
+	return (a0 + a1) + (a2 + a3);
+}
+
+void fir_decimate(const float *in, float *out, uint32_t n_out,
+	const float *taps, int ntaps, int decim)
+{
+	for (uint32_t k=0; k<n_out; k++)
+		out[k] = fir_dot(in + (size_t)k * decim, taps, ntaps);
+}
+
+float db(float x)
+{
+	return 10 * logf(x);
+}
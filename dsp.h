@@ -0,0 +1,193 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DSP_H
+#define __DSP_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* per-sample kernels shared by the capture path and the tools */
+
+struct iq_stats {
+	float ipeak, qpeak;
+	float iavg, qavg;
+	uint32_t count; /* samples accumulated since the last report */
+};
+
+/*!
+ * Convert offset binary samples from the dongle to signed 8 bit, in place
+ *
+ * \param buf interleaved I/Q bytes
+ * \param len number of bytes
+ */
+
+void convert_u8(uint8_t *buf, uint32_t len);
+
+/*!
+ * Copy offset binary samples into a signed 8 bit buffer
+ *
+ * \param dst converted bytes
+ * \param src interleaved I/Q bytes from the dongle
+ * \param len number of bytes
+ */
+
+void convert_copy(uint8_t *dst, const uint8_t *src, uint32_t len);
+
+/*!
+ * Accumulate peak and average power of unconverted I/Q bytes
+ *
+ * \param st statistics to update
+ * \param buf interleaved offset binary I/Q bytes
+ * \param len number of bytes
+ */
+
+void stats_update(struct iq_stats *st, const uint8_t *buf, uint32_t len);
+
+/*!
+ * Print the PEAK/PAR line for the accumulated samples and reset
+ *
+ * \param st statistics to report
+ * \param file stream to print to
+ */
+
+void stats_report(struct iq_stats *st, FILE *file);
+
+/*!
+ * Mean power of signed 8 bit I/Q samples as a ratio
+ *
+ * \param buf interleaved converted I/Q bytes
+ * \param len number of bytes
+ * \return power relative to full scale, 1.0 for a full scale tone
+ */
+
+float mean_power(const uint8_t *buf, uint32_t len);
+
+/*!
+ * Mean power of a block of signed 8 bit I/Q samples
+ *
+ * \param buf interleaved converted I/Q bytes
+ * \param len number of bytes
+ * \return power relative to full scale in dBFS
+ */
+
+float block_power(const uint8_t *buf, uint32_t len);
+
+/*!
+ * Widen signed 8 bit samples to 16 bit integers or floats
+ *
+ * \param in converted bytes
+ * \param out 16 bit samples scaled by 256, or floats with full scale 1.0
+ * \param len number of bytes in
+ * \param bits 16, or 32 for float
+ */
+
+void widen_s8(const int8_t *in, void *out, uint32_t len, int bits);
+
+/*!
+ * Split signed 8 bit I/Q samples into scaled float channels
+ *
+ * \param in interleaved converted I/Q bytes
+ * \param i in-phase output, full scale is 1.0
+ * \param q quadrature output
+ * \param n number of samples
+ */
+
+void deinterleave_s8(const int8_t *in, float *i, float *q, uint32_t n);
+
+/*!
+ * Split signed 16 bit I/Q samples into scaled float channels
+ *
+ * \param in interleaved I/Q samples
+ * \param i in-phase output, full scale is 1.0
+ * \param q quadrature output
+ * \param n number of samples
+ */
+
+void deinterleave_s16(const int16_t *in, float *i, float *q, uint32_t n);
+
+/*!
+ * Join float channels into interleaved samples of the output format
+ *
+ * \param i in-phase input, full scale is 1.0
+ * \param q quadrature input
+ * \param out interleaved samples, 8 or 16 bit signed or 32 bit float
+ * \param n number of samples
+ * \param bits 8, 16 or 32 (float)
+ */
+
+void interleave(const float *i, const float *q, void *out, uint32_t n, int bits);
+
+/*!
+ * Subtract a DC offset from a channel
+ *
+ * \param x samples, modified in place
+ * \param n number of samples
+ * \param dc the offset, e.g. the mean of the whole channel
+ */
+
+void remove_dc(float *x, uint32_t n, float dc);
+
+/*!
+ * Design a windowed sinc low pass filter
+ *
+ * \param taps output coefficients, unity gain at DC
+ * \param ntaps number of coefficients, odd
+ * \param cutoff as a fraction of the sample rate
+ */
+
+void fir_lowpass(float *taps, int ntaps, float cutoff);
+
+/*!
+ * One output of a filter
+ *
+ * \param x ntaps samples, oldest first
+ * \param taps coefficients, in the same order as x
+ * \param ntaps number of coefficients
+ * \return the sum of the products
+ */
+
+float fir_dot(const float *x, const float *taps, int ntaps);
+
+/*!
+ * Filter and decimate one channel
+ *
+ * Output k is computed from in[k * decim] to in[k * decim + ntaps - 1],
+ * so the input needs ntaps - 1 samples of history before the first
+ * sample to be centered.
+ *
+ * \param in samples, history first
+ * \param out n_out filtered samples
+ * \param n_out number of output samples
+ * \param taps coefficients
+ * \param ntaps number of coefficients
+ * \param decim decimation factor
+ */
+
+void fir_decimate(const float *in, float *out, uint32_t n_out,
+	const float *taps, int ntaps, int decim);
+
+/*!
+ * Convert a power ratio to decibels
+ *
+ * \param x power ratio
+ * \return decibels
+ */
+
+float db(float x);
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define _USE_MATH_DEFINES
+#endif
+
+#include <math.h>
+
+#include "fft.h"
+
+int fft_init(struct fft *f, int n)
+{
+	int h, k, bits = 0;
+
+	if (n < 2 || (n & (n - 1))) {
+		return -1;}
+	while ((1 << bits) < n) {
+		bits++;}
+	f->n = n;
+	f->rev = malloc(n * sizeof(uint32_t));
+	f->wr = malloc(n * sizeof(float));
+	f->wi = malloc(n * sizeof(float));
+	f->window = malloc(n * sizeof(float));
+	for (k = 0; k < n; k++) {
+		uint32_t r = 0;
+		int b;
+		for (b = 0; b < bits; b++) {
+			r |= ((k >> b) & 1) << (bits - 1 - b);}
+		f->rev[k] = r;
+		f->window[k] = 0.5 - 0.5 * cos(2 * M_PI * k / n);
+	}
+	/* one contiguous table per stage keeps the butterflies unit stride */
+	for (h = 1; h < n; h *= 2) {
+		for (k = 0; k < h; k++) {
+			f->wr[h + k] = cos(M_PI * k / h);
+			f->wi[h + k] = -sin(M_PI * k / h);
+		}
+	}
+	return 0;
+}
+
+void fft_run(const struct fft *f, float *re, float *im)
+{
+	int n = f->n, h, s, k;
+	float t;
+
+	for (k = 0; k < n; k++) {
+		uint32_t r = f->rev[k];
+		if (r > (uint32_t)k) {
+			t = re[k]; re[k] = re[r]; re[r] = t;
+			t = im[k]; im[k] = im[r]; im[r] = t;
+		}
+	}
+	for (h = 1; h < n; h *= 2) {
+		const float *wr = f->wr + h, *wi = f->wi + h;
+		for (s = 0; s < n; s += 2 * h) {
+			float *ar = re + s, *ai = im + s;
+			float *br = re + s + h, *bi = im + s + h;
+			/* no loop carried dependency, the compiler vectorizes this */
+			for (k = 0; k < h; k++) {
+				float xr = br[k] * wr[k] - bi[k] * wi[k];
+				float xi = br[k] * wi[k] + bi[k] * wr[k];
+				br[k] = ar[k] - xr;
+				bi[k] = ai[k] - xi;
+				ar[k] += xr;
+				ai[k] += xi;
+			}
+		}
+	}
+}
+
+void fft_power(const struct fft *f, float *re, float *im, float *power)
+{
+	int n = f->n, half = n / 2, k;
+	float scale = 4.0f / ((float)n * n);
+
+	for (k = 0; k < n; k++) {
+		re[k] *= f->window[k];
+		im[k] *= f->window[k];
+	}
+	fft_run(f, re, im);
+	for (k = 0; k < half; k++) {
+		power[k] += (re[k + half] * re[k + half] + im[k + half] * im[k + half]) * scale;
+		power[k + half] += (re[k] * re[k] + im[k] * im[k]) * scale;
+	}
+}
+
+void fft_free(struct fft *f)
+{
+	free(f->rev);
+	free(f->wr);
+	free(f->wi);
+	free(f->window);
+}
@@ -0,0 +1,68 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FFT_H
+#define __FFT_H
+
+#include <stdint.h>
+
+/* radix-2 complex FFT on split real and imaginary arrays */
+
+struct fft {
+	int n;
+	uint32_t *rev;	/* bit reversed index of each input */
+	float *wr, *wi;	/* twiddles of the stage of half size h at [h, 2h) */
+	float *window;	/* Hann window, sums to n / 2 */
+};
+
+/*!
+ * Plan a transform, the tables can be shared by any number of threads
+ *
+ * \param f plan to fill in
+ * \param n power of two size
+ * \return 0 on success, -1 if n is not a power of two
+ */
+
+int fft_init(struct fft *f, int n);
+
+/*!
+ * Transform in place
+ *
+ * \param f plan
+ * \param re real parts, n values
+ * \param im imaginary parts, n values
+ */
+
+void fft_run(const struct fft *f, float *re, float *im);
+
+/*!
+ * Window, transform and add the power of each bin
+ *
+ * The bins are rotated so that DC is in the middle, bin k being
+ * (k - n / 2) / n of the sample rate.  Full scale tones add 1.0.
+ *
+ * \param f plan
+ * \param re in-phase samples, overwritten
+ * \param im quadrature samples, overwritten
+ * \param power n sums to add to
+ */
+
+void fft_power(const struct fft *f, float *re, float *im, float *power);
+
+void fft_free(struct fft *f);
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "metrics.h"
+#include "dsp.h"
+#include "wave.h"
+#include "index.h"
+
+int index_open(struct index *ix, const char *path, uint32_t every,
+	uint32_t samp_rate, uint32_t frequency)
+{
+	index_header_t h;
+
+	memset(ix, 0, sizeof(*ix));
+	ix->file = fopen(path, "wb");
+	if (!ix->file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+	ix->every = every ? every : 1;
+	ix->samp_rate = samp_rate;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, INDEX_MAGIC, 4);
+	h.version = INDEX_VERSION;
+	h.record_size = sizeof(index_record_t);
+	h.samp_rate = samp_rate;
+	h.frequency = frequency;
+	h.block_size = 2;
+	h.data_offset = WAVE_HEADER_SIZE;
+	fwrite(&h, 1, sizeof(h), ix->file);
+	fflush(ix->file);
+	return 0;
+}
+
+void index_block(struct index *ix, struct block *b, uint64_t offset)
+{
+	index_record_t r;
+
+	if (b->flags & BLOCK_GAP) {
+		ix->gap = 1;}
+	if (ix->count++ % ix->every) {
+		return;}
+
+	r.sample = b->sample;
+	r.offset = offset;
+	/* blocks arrive once their last sample is in */
+	r.time_ns = metrics_wallclock_ns(b->time) -
+		(int64_t)(b->len / 2) * 1000000000 / ix->samp_rate;
+	r.power = block_power(b->data, b->len);
+	r.flags = ix->gap ? INDEX_GAP : 0;
+	ix->gap = 0;
+	fwrite(&r, 1, sizeof(r), ix->file);
+	/* records are rare, let readers see them right away */
+	fflush(ix->file);
+}
+
+void index_close(struct index *ix)
+{
+	if (ix->file) {
+		fclose(ix->file);}
+	ix->file = NULL;
+}
+
+int64_t index_read_header(int fd, index_header_t *h)
+{
+	struct stat st;
+	if (pread(fd, h, sizeof(*h), 0) != sizeof(*h)) {
+		return -1;}
+	if (memcmp(h->magic, INDEX_MAGIC, 4) != 0 || h->version != INDEX_VERSION) {
+		return -1;}
+	if (h->record_size < sizeof(index_record_t) || fstat(fd, &st) < 0) {
+		return -1;}
+	return (st.st_size - (int64_t)sizeof(*h)) / h->record_size;
+}
+
+int index_read_record(int fd, const index_header_t *h, int64_t n, index_record_t *r)
+{
+	off_t offset = sizeof(*h) + n * h->record_size;
+	if (pread(fd, r, sizeof(*r), offset) != sizeof(*r)) {
+		return -1;}
+	return 0;
+}
+
+int64_t index_search(int fd, const index_header_t *h, int64_t count, int64_t time_ns)
+{
+	int64_t lo = 0, hi = count - 1, mid, found = -1;
+	index_record_t r;
+
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index_read_record(fd, h, mid, &r) < 0) {
+			return -1;}
+		if (r.time_ns <= time_ns) {
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return found;
+}
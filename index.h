@@ -0,0 +1,124 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __INDEX_H
+#define __INDEX_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+/* time to offset seek index, kept in a sidecar next to the capture
+ *
+ * A fixed size header is followed by fixed size records in time
+ * order, so a reader can binary search the file directly.
+ */
+
+#define INDEX_MAGIC	"RWIX"
+#define INDEX_VERSION	1
+#define INDEX_SUFFIX	".idx"
+
+#define INDEX_GAP	1	/* samples were lost before this record */
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t samp_rate;
+    uint32_t frequency;
+    uint32_t block_size;	//bytes per sample frame in the capture
+    uint64_t data_offset;	//first sample byte in the capture
+} __attribute__((packed)) index_header_t;
+
+typedef struct {
+    uint64_t sample;	//stream sample index, counting lost samples
+    uint64_t offset;	//byte offset of the sample in the capture
+    int64_t time_ns;	//UTC wall clock of the sample
+    float power;	//mean block power in dBFS
+    uint32_t flags;
+} __attribute__((packed)) index_record_t;
+
+struct index {
+	FILE *file;
+	uint32_t every;		/* blocks between records */
+	uint32_t samp_rate;
+	uint32_t count;
+	int gap;		/* a gap was seen since the last record */
+};
+
+/*!
+ * Create the sidecar index for a capture
+ *
+ * \param ix the index
+ * \param path of the sidecar
+ * \param every number of blocks between records
+ * \param samp_rate of the capture
+ * \param frequency of the capture
+ * \return 0 on success
+ */
+
+int index_open(struct index *ix, const char *path, uint32_t every,
+	uint32_t samp_rate, uint32_t frequency);
+
+/*!
+ * Note a block written to the capture, recording every Nth one
+ *
+ * \param ix the index
+ * \param b block of converted samples
+ * \param offset byte offset of the block in the capture
+ */
+
+void index_block(struct index *ix, struct block *b, uint64_t offset);
+
+void index_close(struct index *ix);
+
+/*!
+ * Read the header of an index
+ *
+ * \param fd of the sidecar
+ * \param h header to fill in
+ * \return number of records, -1 if this is not an index
+ */
+
+int64_t index_read_header(int fd, index_header_t *h);
+
+/*!
+ * Read one record of an index
+ *
+ * \param fd of the sidecar
+ * \param h header from index_read_header()
+ * \param n record number
+ * \param r record to fill in
+ * \return 0 on success
+ */
+
+int index_read_record(int fd, const index_header_t *h, int64_t n, index_record_t *r);
+
+/*!
+ * Find the last record at or before a time
+ *
+ * \param fd of the sidecar
+ * \param h header from index_read_header()
+ * \param count number of records
+ * \param time_ns UTC time to look up
+ * \return record number, -1 if the time is before the first record
+ */
+
+int64_t index_search(int fd, const index_header_t *h, int64_t count, int64_t time_ns);
+
+#endif
@@ -0,0 +1,247 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "metrics.h"
+
+struct histogram {
+	uint64_t buckets[HIST_BUCKETS];
+	uint64_t count;
+	uint64_t sum;
+};
+
+static const char *histogram_names[H_COUNT] = {
+	"callback_interval_us",
+	"callback_time_us",
+	"write_latency_us",
+	"queue_depth_blocks",
+	"retune_time_us",
+	"writeback_wait_us",
+};
+
+static const char *counter_names[C_COUNT] = {
+	"samples_total",
+	"bytes_written_total",
+	"short_writes_total",
+	"dropped_samples_total",
+	"short_reads_total",
+};
+
+static struct histogram histograms[H_COUNT];
+static uint64_t counters[C_COUNT];
+
+enum export_format {EXPORT_PROM, EXPORT_JSON};
+
+static enum export_format format;
+static char *prom_path;
+static int json_fd = -1;
+static int interval = 2;
+static int running = 0;
+static pthread_t thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+
+/* for the achieved sample rate */
+static uint64_t last_time, last_samples;
+
+uint64_t metrics_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t metrics_wallclock_ns(uint64_t monotonic_us)
+{
+	struct timespec ts;
+	int64_t now;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	now = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	return now - (int64_t)(metrics_now() - monotonic_us) * 1000;
+}
+
+void metrics_observe(enum histogram_id id, uint64_t value)
+{
+	struct histogram *h = &histograms[id];
+	int b = value ? 64 - __builtin_clzll(value) : 0;
+	if (b >= HIST_BUCKETS) {
+		b = HIST_BUCKETS - 1;}
+	__atomic_fetch_add(&h->buckets[b], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&h->sum, value, __ATOMIC_RELAXED);
+}
+
+void metrics_add(enum counter_id id, uint64_t n)
+{
+	__atomic_fetch_add(&counters[id], n, __ATOMIC_RELAXED);
+}
+
+static uint64_t load(uint64_t *p)
+{
+	return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_counter(enum counter_id id)
+{
+	return load(&counters[id]);
+}
+
+static double sample_rate(void)
+{
+	uint64_t t = metrics_now();
+	uint64_t samples = load(&counters[C_SAMPLES]);
+	double rate = 0;
+	if (last_time && t > last_time) {
+		rate = (samples - last_samples) * 1e6 / (t - last_time);}
+	last_time = t;
+	last_samples = samples;
+	return rate;
+}
+
+static void export_prom(FILE *f, double rate)
+{
+	int i, b;
+	uint64_t cumulative;
+	for (i = 0; i < C_COUNT; i++) {
+		fprintf(f, "# TYPE rtl_wave_%s counter\n", counter_names[i]);
+		fprintf(f, "rtl_wave_%s %llu\n", counter_names[i],
+			(unsigned long long)load(&counters[i]));
+	}
+	fprintf(f, "# TYPE rtl_wave_sample_rate gauge\n");
+	fprintf(f, "rtl_wave_sample_rate %.0f\n", rate);
+	for (i = 0; i < H_COUNT; i++) {
+		struct histogram *h = &histograms[i];
+		const char *name = histogram_names[i];
+		fprintf(f, "# TYPE rtl_wave_%s histogram\n", name);
+		cumulative = 0;
+		/* bucket b holds whole values below 2^b, le is inclusive */
+		for (b = 0; b < HIST_BUCKETS - 1; b++) {
+			cumulative += load(&h->buckets[b]);
+			fprintf(f, "rtl_wave_%s_bucket{le=\"%llu\"} %llu\n", name,
+				(1ULL << b) - 1, (unsigned long long)cumulative);
+		}
+		fprintf(f, "rtl_wave_%s_bucket{le=\"+Inf\"} %llu\n", name,
+			(unsigned long long)load(&h->count));
+		fprintf(f, "rtl_wave_%s_sum %llu\n", name,
+			(unsigned long long)load(&h->sum));
+		fprintf(f, "rtl_wave_%s_count %llu\n", name,
+			(unsigned long long)load(&h->count));
+	}
+}
+
+static void export_json(FILE *f, double rate)
+{
+	int i, b;
+	fprintf(f, "{\"time\":%lld", (long long)time(NULL));
+	for (i = 0; i < C_COUNT; i++) {
+		fprintf(f, ",\"%s\":%llu", counter_names[i],
+			(unsigned long long)load(&counters[i]));}
+	fprintf(f, ",\"sample_rate\":%.0f", rate);
+	for (i = 0; i < H_COUNT; i++) {
+		struct histogram *h = &histograms[i];
+		fprintf(f, ",\"%s\":{\"count\":%llu,\"sum\":%llu,\"buckets\":[",
+			histogram_names[i], (unsigned long long)load(&h->count),
+			(unsigned long long)load(&h->sum));
+		for (b = 0; b < HIST_BUCKETS; b++) {
+			fprintf(f, "%s%llu", b ? "," : "",
+				(unsigned long long)load(&h->buckets[b]));}
+		fprintf(f, "]}");
+	}
+	fprintf(f, "}\n");
+}
+
+static void export(void)
+{
+	char tmp[1024];
+	FILE *f;
+	double rate = sample_rate();
+
+	if (format == EXPORT_JSON) {
+		f = fdopen(dup(json_fd), "w");
+		if (!f) {
+			return;}
+		export_json(f, rate);
+		fclose(f);
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%s.tmp", prom_path);
+	f = fopen(tmp, "w");
+	if (!f) {
+		fprintf(stderr, "WARNING: Failed to write %s.\n", tmp);
+		return;
+	}
+	export_prom(f, rate);
+	fclose(f);
+	rename(tmp, prom_path);
+}
+
+static void *exporter(void *arg)
+{
+	struct timespec ts;
+	pthread_mutex_lock(&lock);
+	while (running) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += interval;
+		while (running && pthread_cond_timedwait(&wake, &lock, &ts) != ETIMEDOUT);
+		pthread_mutex_unlock(&lock);
+		export();
+		pthread_mutex_lock(&lock);
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+int metrics_start(char *spec, int interval_seconds)
+{
+	if (strncmp(spec, "prom:", 5) == 0) {
+		format = EXPORT_PROM;
+		prom_path = spec + 5;
+	} else if (strncmp(spec, "json:", 5) == 0) {
+		format = EXPORT_JSON;
+		json_fd = atoi(spec + 5);
+	} else {
+		fprintf(stderr, "Unknown metrics export %s, use prom:path or json:fd\n", spec);
+		return -1;
+	}
+	interval = interval_seconds;
+	last_time = metrics_now();
+	running = 1;
+	if (pthread_create(&thread, NULL, exporter, NULL) != 0) {
+		fprintf(stderr, "WARNING: Failed to start metrics exporter.\n");
+		running = 0;
+		return -1;
+	}
+	return 0;
+}
+
+void metrics_stop(void)
+{
+	if (!running) {
+		return;}
+	pthread_mutex_lock(&lock);
+	running = 0;
+	pthread_cond_signal(&wake);
+	pthread_mutex_unlock(&lock);
+	pthread_join(thread, NULL);
+}
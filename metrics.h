@@ -0,0 +1,116 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdint.h>
+
+/* hot path latency histograms and counters
+ *
+ * Histograms have power of two buckets: bucket i counts values
+ * below 2^i, the last bucket counts everything else.  Updates are
+ * relaxed atomic adds so they are safe to call from the USB callback
+ * while the exporter thread reads them.
+ */
+
+#define HIST_BUCKETS 28
+
+enum histogram_id {
+	H_CALLBACK_INTERVAL,	/* us between USB blocks */
+	H_CALLBACK_TIME,	/* us spent handling a block */
+	H_WRITE_LATENCY,	/* us per write to the output */
+	H_QUEUE_DEPTH,		/* blocks waiting for the writer */
+	H_RETUNE_TIME,		/* us to retune or change the gain */
+	H_WRITEBACK_WAIT,	/* us waiting for a writeback window to reach the disk */
+	H_COUNT
+};
+
+enum counter_id {
+	C_SAMPLES,		/* I/Q pairs received */
+	C_BYTES_WRITTEN,
+	C_SHORT_WRITES,
+	C_DROPPED_SAMPLES,	/* lost to an exhausted buffer pool */
+	C_SHORT_READS,
+	C_COUNT
+};
+
+/*!
+ * Current monotonic time
+ *
+ * \return microseconds
+ */
+
+uint64_t metrics_now(void);
+
+/*!
+ * UTC time of a metrics_now() timestamp
+ *
+ * \param monotonic_us from metrics_now()
+ * \return nanoseconds since 1970
+ */
+
+int64_t metrics_wallclock_ns(uint64_t monotonic_us);
+
+/*!
+ * Add a value to a histogram
+ *
+ * \param id which histogram
+ * \param value in the histogram's unit
+ */
+
+void metrics_observe(enum histogram_id id, uint64_t value);
+
+/*!
+ * Add to a counter
+ *
+ * \param id which counter
+ * \param n amount to add
+ */
+
+void metrics_add(enum counter_id id, uint64_t n);
+
+/*!
+ * Read a counter
+ *
+ * \param id which counter
+ * \return its current value
+ */
+
+uint64_t metrics_counter(enum counter_id id);
+
+/*!
+ * Start a thread exporting the metrics every interval
+ *
+ * "prom:path" rewrites path as a Prometheus textfile, atomically
+ * through a rename; "json:fd" appends one JSON object per line to
+ * an already open file descriptor.
+ *
+ * \param spec export format and target
+ * \param interval_seconds time between exports
+ * \return 0 on success
+ */
+
+int metrics_start(char *spec, int interval_seconds);
+
+/*!
+ * Export one last time and stop the exporter thread
+ */
+
+void metrics_stop(void);
+
+#endif
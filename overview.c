@@ -0,0 +1,151 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include "dsp.h"
+#include "overview.h"
+
+#define FRAME_BYTES	(OVERVIEW_FRAME * 2)
+
+static float overview_db(double p)
+{
+	return p > 0 ? 10 * log10(p) : -100;
+}
+
+int overview_open(struct overview *ov, const char *path,
+	uint32_t samp_rate, uint32_t frequency)
+{
+	overview_header_t h;
+	struct timespec ts;
+	char name[1100];
+	uint64_t samples = (uint64_t)OVERVIEW_FRAME * OVERVIEW_BASE;
+	int k;
+
+	memset(ov, 0, sizeof(*ov));
+	clock_gettime(CLOCK_REALTIME, &ts);
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, OVERVIEW_MAGIC, 4);
+	h.version = OVERVIEW_VERSION;
+	h.record_size = sizeof(overview_record_t);
+	h.samp_rate = samp_rate;
+	h.frequency = frequency;
+	h.start_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+	for (k = 0; k < OVERVIEW_LEVELS; k++, samples *= OVERVIEW_FACTOR) {
+		snprintf(name, sizeof(name), "%s%s%d", path, OVERVIEW_SUFFIX, k);
+		ov->levels[k].file = fopen(name, "wb");
+		if (!ov->levels[k].file) {
+			fprintf(stderr, "Failed to open %s\n", name);
+			overview_close(ov);
+			return -1;
+		}
+		h.level = k;
+		h.samples_per_record = samples;
+		fwrite(&h, 1, sizeof(h), ov->levels[k].file);
+	}
+	return 0;
+}
+
+static void overview_add(struct overview *ov, int k, float min, float max, double mean,
+	uint32_t flags);
+
+/* write out the record of level k and pass it up */
+static void overview_emit(struct overview *ov, int k, uint32_t flags)
+{
+	struct overview_level *l = &ov->levels[k];
+	overview_record_t r;
+	double mean = l->sum / l->count;
+
+	r.min = overview_db(l->min);
+	r.max = overview_db(l->max);
+	r.mean = overview_db(mean);
+	r.flags = l->flags | flags;
+	fwrite(&r, 1, sizeof(r), l->file);
+	/* the coarse levels are what a live viewer polls */
+	if (k) {
+		fflush(l->file);}
+	if (k + 1 < OVERVIEW_LEVELS) {
+		overview_add(ov, k + 1, l->min, l->max, mean, r.flags);}
+	l->sum = 0;
+	l->count = 0;
+	l->flags = 0;
+}
+
+static void overview_add(struct overview *ov, int k, float min, float max, double mean,
+	uint32_t flags)
+{
+	struct overview_level *l = &ov->levels[k];
+	uint32_t full = k ? OVERVIEW_FACTOR : OVERVIEW_BASE;
+
+	if (!l->count || min < l->min) {
+		l->min = min;}
+	if (!l->count || max > l->max) {
+		l->max = max;}
+	l->sum += mean;
+	l->count++;
+	l->flags |= flags & OVERVIEW_GAP;
+	if (l->count == full) {
+		overview_emit(ov, k, 0);}
+}
+
+void overview_block(struct overview *ov, const struct block *b)
+{
+	uint32_t done = 0, piece;
+	float p;
+
+	if (b->flags & BLOCK_GAP) {
+		ov->levels[0].flags |= OVERVIEW_GAP;}
+	while (done < b->len) {
+		piece = b->len - done;
+		if (piece > FRAME_BYTES - ov->frame_fill) {
+			piece = FRAME_BYTES - ov->frame_fill;}
+		ov->frame_sum += (double)mean_power(b->data + done, piece) * (piece / 2);
+		ov->frame_fill += piece;
+		done += piece;
+		if (ov->frame_fill == FRAME_BYTES) {
+			p = ov->frame_sum / OVERVIEW_FRAME;
+			overview_add(ov, 0, p, p, p, 0);
+			ov->frame_sum = 0;
+			ov->frame_fill = 0;
+		}
+	}
+}
+
+void overview_close(struct overview *ov)
+{
+	float p;
+	int k;
+
+	if (ov->frame_fill >= 2 && ov->levels[0].file) {
+		p = ov->frame_sum / (ov->frame_fill / 2);
+		overview_add(ov, 0, p, p, p, 0);
+	}
+	/* lowest first, so each partial record is counted in the next */
+	for (k = 0; k < OVERVIEW_LEVELS; k++) {
+		if (!ov->levels[k].file) {
+			continue;}
+		if (ov->levels[k].count) {
+			overview_emit(ov, k, OVERVIEW_PARTIAL);}
+		fclose(ov->levels[k].file);
+		ov->levels[k].file = NULL;
+	}
+}
@@ -0,0 +1,110 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __OVERVIEW_H
+#define __OVERVIEW_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+/* power overview pyramid, one sidecar per level next to the capture
+ *
+ * The power of every frame of samples is measured; level 0 keeps
+ * the min, max and mean of OVERVIEW_BASE frames per record, and each
+ * level above summarizes OVERVIEW_FACTOR records of the one below.
+ * Record n of a level covers the written samples from
+ * n * samples_per_record on, so a viewer reads only the level that
+ * matches its zoom.
+ */
+
+#define OVERVIEW_MAGIC		"RWPW"
+#define OVERVIEW_VERSION	1
+#define OVERVIEW_SUFFIX		".pw"	/* followed by the level */
+#define OVERVIEW_LEVELS		5
+#define OVERVIEW_FRAME		1024	/* samples per power measurement */
+#define OVERVIEW_BASE		64	/* frames per level 0 record */
+#define OVERVIEW_FACTOR		16	/* records per record of the next level */
+
+#define OVERVIEW_GAP		1	/* samples were lost in this record */
+#define OVERVIEW_PARTIAL	2	/* the capture ended inside this record */
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t level;
+    uint64_t samples_per_record;
+    uint32_t samp_rate;
+    uint32_t frequency;
+    int64_t start_ns;	//UTC time of the first sample
+} __attribute__((packed)) overview_header_t;
+
+typedef struct {
+    float min;		//dBFS of the quietest frame
+    float max;		//dBFS of the loudest frame
+    float mean;		//dBFS of the mean power
+    uint32_t flags;
+} __attribute__((packed)) overview_record_t;
+
+/* a record being filled, powers as ratios */
+struct overview_level {
+	FILE *file;
+	float min, max;
+	double sum;
+	uint32_t count;
+	uint32_t flags;
+};
+
+struct overview {
+	struct overview_level levels[OVERVIEW_LEVELS];
+	double frame_sum;	/* power of the frame being measured */
+	uint32_t frame_fill;	/* and its bytes so far */
+};
+
+/*!
+ * Create the overview sidecars for a capture
+ *
+ * \param ov the overview
+ * \param path of the capture, the level is appended to path.pw
+ * \param samp_rate of the capture
+ * \param frequency of the capture
+ * \return 0 on success
+ */
+
+int overview_open(struct overview *ov, const char *path,
+	uint32_t samp_rate, uint32_t frequency);
+
+/*!
+ * Add a block of converted samples about to be written
+ *
+ * \param ov the overview
+ * \param b the block
+ */
+
+void overview_block(struct overview *ov, const struct block *b);
+
+/*!
+ * Write the records the capture ended inside of and close the sidecars
+ *
+ * \param ov the overview
+ */
+
+void overview_close(struct overview *ov);
+
+#endif
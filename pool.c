@@ -0,0 +1,246 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "pool.h"
+
+#define HUGEPAGE_SIZE (2 * 1024 * 1024)
+
+uint8_t *map_buffer(size_t len, size_t *mapped, const char **backing)
+{
+	uint8_t *mem;
+#if defined(MAP_HUGETLB)
+	size_t huge_len = (len + HUGEPAGE_SIZE - 1) & ~(size_t)(HUGEPAGE_SIZE - 1);
+	mem = mmap(NULL, huge_len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (mem != MAP_FAILED) {
+		*mapped = huge_len;
+		*backing = "hugetlb";
+		return mem;
+	}
+#endif
+#ifndef _WIN32
+	mem = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		return NULL;}
+	*mapped = len;
+	*backing = "plain";
+#if defined(MADV_HUGEPAGE)
+	if (madvise(mem, len, MADV_HUGEPAGE) == 0) {
+		*backing = "thp";}
+#endif
+#else
+	mem = malloc(len);
+	*mapped = len;
+	*backing = "plain";
+#endif
+	return mem;
+}
+
+void unmap_buffer(uint8_t *mem, size_t mapped)
+{
+#ifndef _WIN32
+	munmap(mem, mapped);
+#else
+	free(mem);
+#endif
+}
+
+int pool_init(struct pool *p, int count, uint32_t block_size)
+{
+	int i;
+	memset(p, 0, sizeof(*p));
+	/* keep every block cache line aligned */
+	block_size = (block_size + 63) & ~63U;
+	p->mem = map_buffer((size_t)count * block_size, &p->mem_len, &p->backing);
+	if (!p->mem) {
+		fprintf(stderr, "Failed to allocate %d blocks of %u bytes.\n",
+			count, block_size);
+		return -1;
+	}
+	p->count = count;
+	p->block_size = block_size;
+	p->blocks = calloc(count, sizeof(struct block));
+	p->free = calloc(count, sizeof(struct block *));
+	for (i = 0; i < count; i++) {
+		p->blocks[i].data = p->mem + (size_t)i * block_size;
+		p->free[i] = &p->blocks[count - 1 - i];
+	}
+	p->nfree = count;
+	pthread_mutex_init(&p->lock, NULL);
+	fprintf(stderr, "Buffer pool: %d x %u bytes (%s pages).\n",
+		count, block_size, p->backing);
+	return 0;
+}
+
+struct block *pool_get(struct pool *p)
+{
+	struct block *b = NULL;
+	pthread_mutex_lock(&p->lock);
+	if (p->nfree) {
+		b = p->free[--p->nfree];
+		b->refs = 1;
+	}
+	pthread_mutex_unlock(&p->lock);
+	return b;
+}
+
+void pool_ref(struct block *b)
+{
+	__atomic_add_fetch(&b->refs, 1, __ATOMIC_RELAXED);
+}
+
+void pool_put(struct pool *p, struct block *b)
+{
+	/* the last holder gives the block back */
+	if (__atomic_sub_fetch(&b->refs, 1, __ATOMIC_ACQ_REL)) {
+		return;}
+	pthread_mutex_lock(&p->lock);
+	p->free[p->nfree++] = b;
+	pthread_mutex_unlock(&p->lock);
+}
+
+int pool_used(struct pool *p)
+{
+	int used;
+	pthread_mutex_lock(&p->lock);
+	used = p->count - p->nfree;
+	pthread_mutex_unlock(&p->lock);
+	return used;
+}
+
+void pool_free(struct pool *p)
+{
+	if (!p->mem) {
+		return;}
+	unmap_buffer(p->mem, p->mem_len);
+	free(p->blocks);
+	free(p->free);
+	pthread_mutex_destroy(&p->lock);
+	p->mem = NULL;
+}
+
+int queue_init(struct queue *q, int size)
+{
+	pthread_condattr_t attr;
+	memset(q, 0, sizeof(*q));
+	q->ring = calloc(size, sizeof(struct block *));
+	if (!q->ring) {
+		return -1;}
+	q->size = size;
+	pthread_mutex_init(&q->lock, NULL);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&q->not_empty, &attr);
+	pthread_cond_init(&q->not_full, &attr);
+	pthread_condattr_destroy(&attr);
+	return 0;
+}
+
+int queue_push(struct queue *q, struct block *b)
+{
+	int depth;
+	pthread_mutex_lock(&q->lock);
+	while (q->count == q->size && !q->closed) {
+		pthread_cond_wait(&q->not_full, &q->lock);}
+	if (q->closed) {
+		pthread_mutex_unlock(&q->lock);
+		return -1;
+	}
+	q->ring[(q->head + q->count) % q->size] = b;
+	depth = ++q->count;
+	pthread_cond_signal(&q->not_empty);
+	pthread_mutex_unlock(&q->lock);
+	return depth;
+}
+
+struct block *queue_pop(struct queue *q)
+{
+	return queue_pop_until(q, 0);
+}
+
+struct block *queue_pop_until(struct queue *q, uint64_t deadline)
+{
+	struct block *b = NULL;
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000;
+	ts.tv_nsec = (deadline % 1000000) * 1000;
+	pthread_mutex_lock(&q->lock);
+	while (q->count == 0 && !q->closed) {
+		if (!deadline) {
+			pthread_cond_wait(&q->not_empty, &q->lock);
+		} else if (pthread_cond_timedwait(&q->not_empty, &q->lock, &ts)) {
+			break;}
+	}
+	if (q->count) {
+		b = q->ring[q->head];
+		q->head = (q->head + 1) % q->size;
+		q->count--;
+		pthread_cond_signal(&q->not_full);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return b;
+}
+
+struct block *queue_try_pop(struct queue *q)
+{
+	struct block *b = NULL;
+	pthread_mutex_lock(&q->lock);
+	if (q->count) {
+		b = q->ring[q->head];
+		q->head = (q->head + 1) % q->size;
+		q->count--;
+		pthread_cond_signal(&q->not_full);
+	}
+	pthread_mutex_unlock(&q->lock);
+	return b;
+}
+
+int queue_depth(struct queue *q)
+{
+	int depth;
+	pthread_mutex_lock(&q->lock);
+	depth = q->count;
+	pthread_mutex_unlock(&q->lock);
+	return depth;
+}
+
+void queue_close(struct queue *q)
+{
+	pthread_mutex_lock(&q->lock);
+	q->closed = 1;
+	pthread_cond_broadcast(&q->not_empty);
+	pthread_cond_broadcast(&q->not_full);
+	pthread_mutex_unlock(&q->lock);
+}
+
+void queue_free(struct queue *q)
+{
+	free(q->ring);
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->not_empty);
+	pthread_cond_destroy(&q->not_full);
+}
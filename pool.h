@@ -0,0 +1,202 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __POOL_H
+#define __POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* sample blocks allocated once up front, and the queues passing them
+ * between threads */
+
+#define BLOCK_GAP	1	/* samples were lost before this block */
+
+struct block {
+	uint8_t *data;
+	uint32_t len;		/* bytes of samples in data */
+	uint32_t flags;
+	uint64_t sample;	/* stream index of the first sample, counting lost ones */
+	uint64_t time;		/* arrival, from metrics_now() */
+	int refs;		/* holders, the block is free again at 0 */
+};
+
+struct pool {
+	uint8_t *mem;
+	size_t mem_len;
+	const char *backing;	/* "hugetlb", "thp" or "plain" */
+	uint32_t block_size;
+	int count;
+	struct block *blocks;
+	struct block **free;
+	int nfree;
+	pthread_mutex_t lock;
+};
+
+struct queue {
+	struct block **ring;
+	int size;
+	int head;
+	int count;
+	int closed;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
+};
+
+/*!
+ * Map a large sample buffer
+ *
+ * Explicit hugepages are tried first, then transparent hugepages,
+ * then ordinary pages.
+ *
+ * \param len bytes needed
+ * \param mapped set to the bytes mapped, len rounded up to the page size
+ * \param backing set to "hugetlb", "thp" or "plain"
+ * \return the buffer, NULL on failure
+ */
+
+uint8_t *map_buffer(size_t len, size_t *mapped, const char **backing);
+
+/*!
+ * Unmap a buffer from map_buffer()
+ *
+ * \param mem the buffer
+ * \param mapped its mapped length
+ */
+
+void unmap_buffer(uint8_t *mem, size_t mapped);
+
+/*!
+ * Allocate count blocks of block_size bytes in one mapping
+ *
+ * The blocks live in one buffer from map_buffer().
+ *
+ * \param p the pool
+ * \param count number of blocks
+ * \param block_size bytes per block
+ * \return 0 on success
+ */
+
+int pool_init(struct pool *p, int count, uint32_t block_size);
+
+/*!
+ * Take a free block without waiting
+ *
+ * \param p the pool
+ * \return a block, NULL when the pool is exhausted
+ */
+
+struct block *pool_get(struct pool *p);
+
+/*!
+ * Take another reference to a block, to share it read only
+ *
+ * \param b a block taken with pool_get()
+ */
+
+void pool_ref(struct block *b);
+
+/*!
+ * Drop a reference to a block, returning it to the pool with the last
+ *
+ * \param p the pool
+ * \param b a block taken with pool_get()
+ */
+
+void pool_put(struct pool *p, struct block *b);
+
+/*!
+ * Number of blocks currently handed out
+ *
+ * \param p the pool
+ * \return blocks in use
+ */
+
+int pool_used(struct pool *p);
+
+void pool_free(struct pool *p);
+
+/*!
+ * Create a bounded queue of blocks
+ *
+ * \param q the queue
+ * \param size maximum number of queued blocks
+ * \return 0 on success
+ */
+
+int queue_init(struct queue *q, int size);
+
+/*!
+ * Append a block, waiting while the queue is full
+ *
+ * \param q the queue
+ * \param b block to append
+ * \return queue depth after the push, -1 if the queue is closed
+ */
+
+int queue_push(struct queue *q, struct block *b);
+
+/*!
+ * Remove the oldest block, waiting while the queue is empty
+ *
+ * \param q the queue
+ * \return a block, NULL once the queue is closed and drained
+ */
+
+struct block *queue_pop(struct queue *q);
+
+/*!
+ * Remove the oldest block, waiting no later than a deadline
+ *
+ * \param q the queue
+ * \param deadline CLOCK_MONOTONIC time in us, 0 to wait forever
+ * \return a block, NULL at the deadline or once the queue is drained
+ */
+
+struct block *queue_pop_until(struct queue *q, uint64_t deadline);
+
+/*!
+ * Remove the oldest block without waiting
+ *
+ * \param q the queue
+ * \return a block, NULL when the queue is empty
+ */
+
+struct block *queue_try_pop(struct queue *q);
+
+/*!
+ * Number of blocks queued
+ *
+ * \param q the queue
+ * \return queue depth
+ */
+
+int queue_depth(struct queue *q);
+
+/*!
+ * Wake all waiters, no more blocks will be pushed
+ *
+ * \param q the queue
+ */
+
+void queue_close(struct queue *q);
+
+void queue_free(struct queue *q);
+
+#endif
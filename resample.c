@@ -0,0 +1,172 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "dsp.h"
+#include "resample.h"
+
+/* the filter is flat to 0.4 of the lower rate and stops from 0.6,
+ * a blackman window needs 5.5 taps over the transition width */
+#define TRANSITION	0.2
+#define BLACKMAN_WIDTH	5.5
+
+static uint32_t resample_gcd(uint32_t a, uint32_t b)
+{
+	uint32_t t;
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+const char *resample_dest(const char *dest)
+{
+	const char *rest;
+	if (strncmp(dest, RESAMPLE_PREFIX, strlen(RESAMPLE_PREFIX)) != 0) {
+		return NULL;}
+	rest = strchr(dest, ':');
+	return rest ? rest + 1 : NULL;
+}
+
+int resample_open(struct resample *r, const char *spec, uint32_t in_rate)
+{
+	char *end;
+	double rate, lower;
+	uint64_t total;
+	uint32_t g, p;
+	float *proto;
+	int j;
+
+	memset(r, 0, sizeof(*r));
+	if (strncmp(spec, RESAMPLE_PREFIX, strlen(RESAMPLE_PREFIX)) == 0) {
+		spec += strlen(RESAMPLE_PREFIX);}
+	rate = strtod(spec, &end);
+	if (*end == 'k' || *end == 'K') {
+		rate *= 1e3;
+	} else if (*end == 'M') {
+		rate *= 1e6;}
+	if (rate < 1 || rate > UINT32_MAX || !in_rate) {
+		fprintf(stderr, "Resampler rate %s is not a rate.\n", spec);
+		return -1;
+	}
+	r->in_rate = in_rate;
+	r->out_rate = (uint32_t)lrint(rate);
+	g = resample_gcd(in_rate, r->out_rate);
+	r->up = r->out_rate / g;
+	r->down = in_rate / g;
+
+	lower = in_rate < r->out_rate ? in_rate : r->out_rate;
+	r->ntaps = (int)ceil(BLACKMAN_WIDTH * in_rate / (TRANSITION * lower));
+	total = (uint64_t)r->ntaps * r->up;
+	if (total > RESAMPLE_MAX_TAPS) {
+		fprintf(stderr, "Resampling %u to %u samples/second, %u/%u, needs too many taps;"
+			" pick a rate with more in common with %u.\n",
+			in_rate, r->out_rate, r->up, r->down, in_rate);
+		return -1;
+	}
+
+	proto = calloc(total, sizeof(float));
+	r->bank = malloc(total * sizeof(float));
+	r->buf_i = calloc(r->ntaps + RESAMPLE_CHUNK, sizeof(float));
+	r->buf_q = calloc(r->ntaps + RESAMPLE_CHUNK, sizeof(float));
+	if (!proto || !r->bank || !r->buf_i || !r->buf_q) {
+		free(proto);
+		resample_free(r);
+		return -1;
+	}
+	/* fir_lowpass() wants an odd length, an even bank ends in a 0 */
+	fir_lowpass(proto, total & 1 ? total : total - 1, 0.5 * lower / ((double)in_rate * r->up));
+	/* phase p takes every up'th tap from p, oldest input first, and
+	 * the gain of the zeros stuffed between inputs */
+	for (p = 0; p < r->up; p++) {
+		for (j = 0; j < r->ntaps; j++) {
+			r->bank[p * r->ntaps + j] = r->up * proto[p + (uint64_t)(r->ntaps - 1 - j) * r->up];}
+	}
+	free(proto);
+
+	/* the stream starts from silence */
+	r->fill = r->ntaps - 1;
+	r->next = r->ntaps - 1;
+	return 0;
+}
+
+static int16_t resample_s16(float x)
+{
+	x *= 32767;
+	return (int16_t)lrintf(x < -32768 ? -32768 : (x > 32767 ? 32767 : x));
+}
+
+uint32_t resample_block(struct resample *r, const uint8_t *buf, uint32_t len, int16_t **out)
+{
+	uint32_t samples = len / 2, done = 0, total = 0, n, shift;
+	uint64_t need = (uint64_t)samples * r->up / r->down + 2;
+	const float *taps;
+	int16_t *o;
+
+	if (need > r->out_len) {
+		free(r->out);
+		r->out = malloc(need * 2 * sizeof(int16_t));
+		r->out_len = r->out ? need : 0;
+		if (!r->out) {
+			return 0;}
+	}
+	while (done < samples) {
+		n = samples - done < RESAMPLE_CHUNK ? samples - done : RESAMPLE_CHUNK;
+		deinterleave_s8((const int8_t *)buf + 2 * done, r->buf_i + r->fill,
+			r->buf_q + r->fill, n);
+		done += n;
+		r->fill += n;
+
+		while (r->next < r->fill) {
+			taps = r->bank + (size_t)r->phase * r->ntaps;
+			o = r->out + 2 * total++;
+			o[0] = resample_s16(fir_dot(r->buf_i + r->next + 1 - r->ntaps, taps, r->ntaps));
+			o[1] = resample_s16(fir_dot(r->buf_q + r->next + 1 - r->ntaps, taps, r->ntaps));
+			r->phase += r->down;
+			r->next += r->phase / r->up;
+			r->phase %= r->up;
+		}
+
+		/* keep the history of the next output */
+		shift = r->next + 1 - r->ntaps;
+		if (shift > r->fill) {
+			shift = r->fill;}
+		r->fill -= shift;
+		r->next -= shift;
+		memmove(r->buf_i, r->buf_i + shift, r->fill * sizeof(float));
+		memmove(r->buf_q, r->buf_q + shift, r->fill * sizeof(float));
+	}
+	*out = r->out;
+	return total;
+}
+
+void resample_free(struct resample *r)
+{
+	free(r->bank);
+	free(r->buf_i);
+	free(r->buf_q);
+	free(r->out);
+	r->bank = r->buf_i = r->buf_q = NULL;
+	r->out = NULL;
+	r->out_len = 0;
+}
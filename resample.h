@@ -0,0 +1,88 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RESAMPLE_H
+#define __RESAMPLE_H
+
+#include <stdint.h>
+
+/* a polyphase rational resampler, from the tuner rate to any rate
+ *
+ * The output rate is the input rate times up/down, reduced by their
+ * greatest common divisor.  One low pass filter at up times the
+ * input rate, cut off at half the lower of the two rates, is split
+ * into up phases of ntaps coefficients when the resampler is set up;
+ * output m is then the dot product of phase m * down % up with the
+ * ntaps inputs ending at m * down / up.
+ */
+
+#define RESAMPLE_PREFIX		"resample@"
+#define RESAMPLE_CHUNK		4096		/* input samples worked on at a time */
+#define RESAMPLE_MAX_TAPS	(1 << 22)	/* in the whole bank */
+
+struct resample {
+	uint32_t in_rate, out_rate;
+	uint32_t up, down;
+	int ntaps;		/* per phase */
+	float *bank;		/* up phases of ntaps coefficients */
+	uint32_t phase;		/* of the next output */
+	uint32_t next;		/* position in buf of its newest input */
+	float *buf_i, *buf_q;	/* history, then the inputs not yet used */
+	uint32_t fill;
+	int16_t *out;
+	uint32_t out_len;	/* samples out has room for */
+};
+
+/*!
+ * Strip the resampler from a sink destination
+ *
+ * \param dest e.g. "resample@192k:hdsdr.wav"
+ * \return what follows the rate, "hdsdr.wav", or NULL if dest does
+ *         not start with RESAMPLE_PREFIX
+ */
+
+const char *resample_dest(const char *dest);
+
+/*!
+ * Set up a resampler and its filter bank
+ *
+ * \param r the resampler
+ * \param spec RESAMPLE_PREFIX then the output rate, with an optional
+ *        k or M suffix
+ * \param in_rate input samples/second
+ * \return 0 on success, -1 for a bad rate or one whose ratio to the
+ *         input rate needs more than RESAMPLE_MAX_TAPS coefficients
+ */
+
+int resample_open(struct resample *r, const char *spec, uint32_t in_rate);
+
+/*!
+ * Resample a block
+ *
+ * \param r the resampler
+ * \param buf converted interleaved signed 8 bit I/Q samples
+ * \param len number of bytes
+ * \param out set to interleaved 16 bit I/Q samples, valid until the
+ *        next call
+ * \return number of I/Q samples in out
+ */
+
+uint32_t resample_block(struct resample *r, const uint8_t *buf, uint32_t len, int16_t **out);
+
+void resample_free(struct resample *r);
+
+#endif
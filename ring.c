@@ -0,0 +1,85 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "dsp.h"
+#include "pool.h"
+#include "ring.h"
+
+int ring_init(struct ring *r, size_t size)
+{
+	memset(r, 0, sizeof(*r));
+	size &= ~(size_t)1;
+	r->mem = map_buffer(size, &r->mapped, &r->backing);
+	if (!r->mem) {
+		fprintf(stderr, "Failed to allocate a ring of %zu bytes.\n", size);
+		return -1;
+	}
+	r->size = size;
+	fprintf(stderr, "Sample ring: %zu bytes (%s pages).\n", size, r->backing);
+	return 0;
+}
+
+void ring_push(struct ring *r, const uint8_t *buf, uint32_t len)
+{
+	uint64_t head = r->head;
+	size_t at = head % r->size, first = r->size - at;
+
+	if (len > r->most) {
+		__atomic_store_n(&r->most, len, __ATOMIC_RELAXED);}
+	if (first > len) {
+		first = len;}
+	convert_copy(r->mem + at, buf, first);
+	convert_copy(r->mem, buf + first, len - first);
+	__atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+}
+
+uint64_t ring_head(struct ring *r)
+{
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+}
+
+/* a push in progress may already be writing up to most bytes past the head */
+static int ring_valid(struct ring *r, uint64_t pos)
+{
+	uint64_t limit = ring_head(r) + __atomic_load_n(&r->most, __ATOMIC_RELAXED);
+	return limit <= pos + r->size;
+}
+
+int ring_read(struct ring *r, uint64_t pos, uint8_t *buf, size_t len)
+{
+	size_t at = pos % r->size, first = r->size - at;
+
+	if (!ring_valid(r, pos)) {
+		return -1;}
+	if (first > len) {
+		first = len;}
+	memcpy(buf, r->mem + at, first);
+	memcpy(buf + first, r->mem, len - first);
+	/* the copy must be complete before the head is checked again */
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return ring_valid(r, pos) ? 0 : -1;
+}
+
+void ring_free(struct ring *r)
+{
+	if (r->mem) {
+		unmap_buffer(r->mem, r->mapped);}
+	r->mem = NULL;
+}
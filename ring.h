@@ -0,0 +1,83 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RING_H
+#define __RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* the latest converted samples, kept in memory for dumps on demand
+ *
+ * One thread pushes, any thread may read back what has not been
+ * overwritten yet.
+ */
+
+struct ring {
+	uint8_t *mem;
+	size_t size;		/* bytes held */
+	size_t mapped;
+	const char *backing;
+	uint64_t head;		/* bytes ever pushed */
+	uint32_t most;		/* largest push, which a reader keeps clear of */
+};
+
+/*!
+ * Map the ring
+ *
+ * \param r the ring
+ * \param size bytes to hold, rounded down to whole samples
+ * \return 0 on success
+ */
+
+int ring_init(struct ring *r, size_t size);
+
+/*!
+ * Convert offset binary samples into the ring, over the oldest ones
+ *
+ * \param r the ring
+ * \param buf interleaved I/Q bytes from the dongle
+ * \param len number of bytes
+ */
+
+void ring_push(struct ring *r, const uint8_t *buf, uint32_t len);
+
+/*!
+ * Bytes pushed so far
+ *
+ * \param r the ring
+ * \return the position after the newest byte
+ */
+
+uint64_t ring_head(struct ring *r);
+
+/*!
+ * Copy samples out of the ring
+ *
+ * \param r the ring
+ * \param pos position of the first byte, at most size bytes behind the head
+ * \param buf destination
+ * \param len number of bytes
+ * \return 0 on success, -1 if the bytes were overwritten before or
+ *         while they were copied
+ */
+
+int ring_read(struct ring *r, uint64_t pos, uint8_t *buf, size_t len);
+
+void ring_free(struct ring *r);
+
+#endif
@@ -23,6 +23,8 @@
 #include <stdlib.h>
 #include <time.h>
 #include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
 
 #ifndef _WIN32
 #include <unistd.h>
@@ -35,15 +37,116 @@
 
 #include "rtl-sdr.h"
 #include "convenience.h"
+#include "wave.h"
+#include "dsp.h"
+#include "metrics.h"
+#include "pool.h"
+#include "writer.h"
+#include "control.h"
+#include "ring.h"
+#include "burst.h"
+#include "sink.h"
+#include "sigmf.h"
+#include "synth.h"
 
 #define DEFAULT_SAMPLE_RATE		2048000
 #define DEFAULT_BUF_LENGTH		(16 * 16384)
 #define MINIMAL_BUF_LENGTH		512
 #define MAXIMAL_BUF_LENGTH		(256 * 16384)
+#define DEFAULT_POOL_BLOCKS		32
+#define DUMP_CHUNK			(1 << 20)
 
 static int do_exit = 0;
 static uint64_t bytes_to_read = 0;
 static rtlsdr_dev_t *dev = NULL;
+static struct synth synth;	/* stands in for dev with -d synth:... */
+static int synth_mode = 0;
+static uint64_t last_arrival = 0;
+static struct pool pool;
+static int dropping = 0;
+static uint64_t samples_seen = 0;
+static struct iq_stats stats;
+static char startup[256];
+static uint64_t startup_last = 0;
+static int first_sample = 1;
+
+/* capture settings, changed at run time by the control socket */
+static uint32_t samp_rate = DEFAULT_SAMPLE_RATE;
+static uint32_t frequency = 100000000;
+static int gain = 0;
+
+/* output settings, applied to every recording */
+static int sync_mode = 0;
+static int adaptive = 0;
+static int latency_ms = 0;
+static int header_seconds = -1;
+static uint32_t index_every = 0;
+static int checksums = 0;
+static int overviews = 0;
+static int sigmf_bits = 0;	/* SigMF of this sample size instead of WAVE */
+static char hw[256];	/* the receiver, for the SigMF metadata */
+static int daemon_mode = 0;
+static int settle_ms = 10;
+static double ring_file_seconds = 0;
+static uint64_t writeback_window = 0;
+static uint64_t writeback_keep = 0;
+static uint32_t write_align = 0;
+
+/* time machine, the latest samples kept in memory and dumped by
+ * their own thread on SIGUSR1 or a dump command */
+static double ring_seconds = 0;
+static struct ring ring;
+static char *dump_prefix = "rtl_wave";
+static sem_t dump_sem;
+static pthread_t dump_thread;
+static pthread_mutex_t dump_lock = PTHREAD_MUTEX_INITIALIZER;
+static int dump_queued = 0;	/* a dump command is waiting */
+static double dump_seconds;
+static char dump_path[1024];
+static volatile int dump_stop = 0;
+
+/* bursts cut out of the ring by threads of their own */
+#define BURST_RING_SECONDS 4
+static struct bursts bursts;
+
+/* the stream sample the latest block ended on and when it arrived,
+ * to place tuning changes made by other threads */
+static uint64_t clock_sample, clock_time;
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* one output file and the writer thread feeding it */
+struct recording {
+	struct writer writer;
+	struct index index;
+	struct checksum checksum;
+	struct overview overview;
+	struct sigmf sigmf;
+	FILE *file;
+	char path[1024];
+};
+
+/* the recording blocks go to, only changed by the capture thread
+ * at a block boundary when a switch is pending */
+static struct recording *recording = NULL;
+static struct recording *pending = NULL;
+static int switch_pending = 0;
+static uint64_t switch_sample;
+static pthread_mutex_t switch_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t switch_done = PTHREAD_COND_INITIALIZER;
+
+/* extra outputs fed the converted blocks for the whole run */
+static struct sink sinks[SINK_MAX];
+static int nsinks = 0;
+
+///////////////////////////////////
+
+int interval_seconds = 2; 
+
+///////////////////////////////////
+
+/* cpus for the capture, writer and analysis threads, -1 leaves them unpinned */
+enum {CPU_CAPTURE, CPU_WRITER, CPU_ANALYSIS, CPU_ROLES};
+static int cpus[CPU_ROLES] = {-1, -1, -1};
 
 void usage(void)
 {
@@ -52,15 +155,52 @@ void usage(void)
 		"Usage:\t -f frequency_to_tune_to [Hz]\n"
 		"\t[-s samplerate (default: 2048000 Hz)]\n"
 		"\t[-d device_index (default: 0)]\n"
+		"\t    (synth:item,... for a synthetic source, see the README)\n"
 		"\t[-g gain (default: 0 for auto)]\n"
 		"\t[-p ppm_error (default: 0)]\n"
 		"\t[-b output_block_size (default: 16 * 16384)]\n"
+		"\t[-B number of USB transfers (default: 0, library default)]\n"
+		"\t[-Q number of blocks in the buffer pool (default: 32)]\n"
+		"\t[-a latency_ms, adapt the block size to the writer (default: off)]\n"
+		"\t    (0 for no latency target)\n"
+		"\t[-u seconds between WAVE header size updates (default: off)]\n"
+		"\t[-x blocks between seek index records in filename.idx (default: off)]\n"
+		"\t[-c CRC32C of every block in filename.crc (default: off)]\n"
+		"\t[-P power overview pyramid in filename.pw0 to .pw4 (default: off)]\n"
+		"\t[-w writeback window[,bytes kept cached behind it], e.g. 8M (default: off)]\n"
+		"\t[-k bytes, a power of two, to align the end of every write to, e.g. 4k (default: off)]\n"
+		"\t[-m ci8|ci16|cf32, write SigMF filename.sigmf-data and -meta (default: WAVE)]\n"
 		"\t[-n number of samples to read (default: 0, infinite)]\n"
 		"\t[-S force sync output (default: async)]\n"
-		"\tfilename (a '-' dumps samples to stdout)\n\n");
+		"\t[-M metrics export, prom:path or json:fd (default: off)]\n"
+		"\t[-R SCHED_FIFO priority for the capture thread (default: off)]\n"
+		"\t[-A cpus for the capture,writer,analysis threads (default: unpinned)]\n"
+		"\t[-L lock and prefault all memory (default: off)]\n"
+		"\t[-D control socket, keep streaming and take commands (default: off)]\n"
+		"\t[-T settling time in ms flagged after a retune or gain change (default: 10)]\n"
+		"\t[-W seconds to keep in memory, dumped on SIGUSR1 (default: off)]\n"
+		"\t[-F seconds to keep in a fixed size circular file (default: off)]\n"
+		"\t    (filename is then the prefix of the dumps, nothing else is recorded)\n"
+		"\t[-O extra output, repeatable: path, -, tcp:[host:]port or shm:name[:seconds]\n"
+		"\t    then optionally ,block|newest|oldest|spill[,depth in blocks];\n"
+		"\t    am|nbfm|wbfm[@offset]: ahead of any but shm: for audio,\n"
+		"\t    resample@rate: for 16 bit I/Q at that rate]\n"
+		"\t[-X write only bursts, to prefix-<sample>.wav or archive:path\n"
+		"\t    then optionally ,dB over the floor[,hold ms[,padding ms[,threads]]]\n"
+		"\t    (default: off, 10 dB, 5 ms, 1 ms, 2 threads)]\n"
+		"\tfilename (a '-' dumps samples to stdout, optional with -D, -W, -O or -X)\n\n");
 	exit(1);
 }
 
+/* stop the async read, of the dongle or the synthetic source */
+static void capture_cancel(void)
+{
+	if (synth_mode)
+		synth_cancel(&synth);
+	else
+		rtlsdr_cancel_async(dev);
+}
+
 #ifdef _WIN32
 BOOL WINAPI
 sighandler(int signum)
@@ -68,7 +208,7 @@ sighandler(int signum)
 	if (CTRL_C_EVENT == signum) {
 		fprintf(stderr, "Signal caught, exiting!\n");
 		do_exit = 1;
-		rtlsdr_cancel_async(dev);
+		capture_cancel();
 		return TRUE;
 	}
 	return FALSE;
@@ -78,158 +218,593 @@ static void sighandler(int signum)
 {
 	fprintf(stderr, "Signal caught, exiting!\n");
 	do_exit = 1;
-	rtlsdr_cancel_async(dev);
+	capture_cancel();
+}
+
+static void dump_signal(int signum)
+{
+	sem_post(&dump_sem);
 }
 #endif
 
+/* add the time since the previous phase of startup to the report */
+static void startup_phase(const char *name)
+{
+	uint64_t t = metrics_now();
+	size_t len = strlen(startup);
+	snprintf(startup + len, sizeof(startup) - len, "%s%s %.1f",
+		len ? ", " : "", name, (t - startup_last) / 1e3);
+	startup_last = t;
+}
+
+/* note a block arriving from the dongle, returns the arrival time */
+static uint64_t block_arrived(uint32_t len)
+{
+	uint64_t t = metrics_now();
+	if (first_sample) {
+		first_sample = 0;
+		startup_phase("first sample");
+		fprintf(stderr, "Startup (ms): %s\n", startup);
+	}
+	if (last_arrival)
+		metrics_observe(H_CALLBACK_INTERVAL, t - last_arrival);
+	last_arrival = t;
+	metrics_add(C_SAMPLES, len / 2);
+	pthread_mutex_lock(&clock_lock);
+	clock_sample = samples_seen + len / 2;
+	clock_time = t;
+	pthread_mutex_unlock(&clock_lock);
+	return t;
+}
+
+/* stream index of the sample being taken now, from the latest block;
+ * USB transfer latency is not accounted for */
+static uint64_t sample_now(void)
+{
+	uint64_t sample, t;
+	pthread_mutex_lock(&clock_lock);
+	sample = clock_sample;
+	t = clock_time;
+	pthread_mutex_unlock(&clock_lock);
+	if (!t)
+		return 0;
+	return sample + (metrics_now() - t) * samp_rate / 1000000;
+}
+
+/* take up a pending switch, called by the capture thread before each block */
+static int recording_poll(void)
+{
+	if (!__atomic_load_n(&switch_pending, __ATOMIC_ACQUIRE))
+		return 0;
+	pthread_mutex_lock(&switch_lock);
+	/* in sync mode the old writer feeds the sinks, let it finish
+	 * before this thread hands them the next block */
+	if (sync_mode && nsinks && recording && recording != pending)
+		writer_drain(&recording->writer);
+	recording = pending;
+	switch_sample = samples_seen;
+	switch_pending = 0;
+	dropping = 0;
+	pthread_cond_broadcast(&switch_done);
+	pthread_mutex_unlock(&switch_lock);
+	return 1;
+}
+
+/* a failed write ends the capture, except in daemon mode where it only
+ * ends the recording */
+static int recording_failed(void)
+{
+	return recording && recording->writer.failed && !daemon_mode;
+}
+
+/* give every sink a reference to a converted block */
+static void sinks_submit(struct block *b)
+{
+	int i;
+	for (i = 0; i < nsinks; i++)
+		sink_submit(&sinks[i], b);
+}
+
 static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
 {
 	if (ctx) {
 		if (do_exit)
 			return;
 
+		uint64_t arrival = block_arrived(len);
+
 		if ((bytes_to_read > 0) && (bytes_to_read < len)) {
 			len = bytes_to_read;
 			do_exit = 1;
-			rtlsdr_cancel_async(dev);
+			capture_cancel();
 		}
 
-		for (int n=0; n<len; n++) buf[n] = buf[n] - 128;
+		if (ring.mem) {
+			ring_push(&ring, buf, len);
+			bursts_notify(&bursts);
+		}
 
-		if (fwrite(buf, 1, len, (FILE*)ctx) != len) {
-			fprintf(stderr, "Short write, samples lost, exiting!\n");
-			rtlsdr_cancel_async(dev);
+		recording_poll();
+		struct block *b = recording || nsinks ? pool_get(&pool) : NULL;
+
+		if (!recording && !nsinks) {
+			samples_seen += len / 2;
+		} else if (!b) {
+			if (!dropping)
+				fprintf(stderr, "Buffer pool exhausted, samples lost!\n");
+			dropping = 1;
+			metrics_add(C_DROPPED_SAMPLES, len / 2);
+			samples_seen += len / 2;
+		} else {
+			b->flags = dropping ? BLOCK_GAP : 0;
+			dropping = 0;
+			convert_copy(b->data, buf, len);
+			b->len = len;
+			b->sample = samples_seen;
+			samples_seen += len / 2;
+			b->time = arrival;
+			sinks_submit(b);
+			if (recording)
+				writer_submit(&recording->writer, b);
+			else
+				pool_put(&pool, b);
 		}
 
+		if (recording_failed())
+			capture_cancel();
+
 		if (bytes_to_read > 0)
 			bytes_to_read -= len;
+
+		metrics_observe(H_CALLBACK_TIME, metrics_now() - arrival);
 	}
 }
 
 
 
-///////////////////////////////////
+/* statistics and conversion of sync mode blocks, run by the writer thread */
+static void sync_process(struct block *b, void *ctx)
+{
+        //////////////////////////////////////////
+
+        stats_update(&stats, b->data, b->len);
+        if (stats.count > samp_rate * interval_seconds)
+            stats_report(&stats, stderr);
+
+        //////////////////////////////////////////
+
+	convert_u8(b->data, b->len);
+
+	/* the sinks take the block converted, after the recording's
+	 * writer thread in this mode */
+	sinks_submit(b);
+}
 
-// datetime
-
-typedef struct {
-    uint16_t year;
-    uint16_t month;
-    uint16_t day_of_week;
-    uint16_t day;
-    uint16_t hour;
-    uint16_t minute;
-    uint16_t second;
-    uint16_t milliseconds;
-} __attribute__((packed)) datetime_t;
-
-// riff
-
-typedef struct {
-    char id[4];
-    uint32_t size;
-    char type[4];
-} __attribute__((packed)) riff_t;
-
-// fmt
-
-typedef struct {
-    uint16_t format_tag;
-    uint16_t channels;
-    uint32_t samples_per_sec;
-    uint32_t data_rate;
-    uint16_t block_size;
-    uint16_t bits_per_sample;
-} __attribute__((packed)) fmt_t;
-
-// auxi
-
-typedef struct {
-    datetime_t start_time;
-    datetime_t stop_time;
-    uint32_t frequency; //receiver center frequency
-    uint32_t sample_frequency; //A/D sample frequency before downsampling
-    uint32_t if_frequency; //IF freq if an external down converter is used
-    uint32_t bandwidth; //displayable BW
-    uint32_t dc_offset; //DC offset of I/Q channels in 1/1000's of a count
-} __attribute__((packed)) auxi_t;
-
-// chunk
-
-typedef struct {
-    char id[4];
-    uint32_t size;
-} __attribute__((packed)) chunk_t;
-
-
-void set_datetime(datetime_t* dt)
+static void recording_close(struct recording *rec)
 {
-    time_t rawtime = time(NULL);
-    struct tm *tm = gmtime(&rawtime);
-    dt->year = tm->tm_year + 1900;
-    dt->month = tm->tm_mon + 1;
-    dt->day = tm->tm_mday;
-    dt->hour = tm->tm_hour;
-    dt->minute = tm->tm_min;
-    dt->second = tm->tm_sec;
+	writer_stop(&rec->writer);
+	if (rec->writer.index)
+		index_close(rec->writer.index);
+	if (rec->writer.checksum)
+		checksum_close(rec->writer.checksum);
+	if (rec->writer.overview)
+		overview_close(rec->writer.overview);
+	if (rec->writer.sigmf)
+		sigmf_close(rec->writer.sigmf);
+	if (rec->file != stdout)
+		fclose(rec->file);
+	free(rec);
 }
 
-void wave_header(FILE *file, uint32_t samp_rate, uint32_t frequency, uint32_t bits_per_sample)
+/* the name of a SigMF recording without any of its suffixes */
+static void sigmf_base(char *base, size_t len, const char *path)
 {
-    riff_t riff;
-    fmt_t fmt;
-    chunk_t chunk;
-    auxi_t auxi;
-
-    // write riff header
-    memset(&riff, 0, sizeof(riff_t));
-    strncpy(riff.id, "RIFF", 4);
-    strncpy(riff.type, "WAVE", 4);
-    riff.size = -1;
-    if (fwrite(&riff, 1, sizeof(riff_t), file) != sizeof(riff_t)) exit(1);
-
-    // write fmt header
-    memset(&chunk, 0, sizeof(chunk_t));
-    strncpy(chunk.id, "fmt ", 4);
-    chunk.size = sizeof(fmt_t);
-    if (fwrite(&chunk, 1, sizeof(chunk_t), file) != sizeof(chunk_t)) exit(1);
-
-    // write fmt data
-    memset(&fmt, 0, sizeof(fmt_t));
-    fmt.format_tag = 1; // PCM
-    fmt.channels = 2;
-    fmt.bits_per_sample = bits_per_sample;
-    fmt.samples_per_sec = samp_rate;
-    fmt.data_rate = fmt.channels * fmt.bits_per_sample / 8 * fmt.samples_per_sec;
-    fmt.block_size = fmt.channels * fmt.bits_per_sample / 8;
-    if (fwrite(&fmt, 1, sizeof(fmt_t), file) != sizeof(fmt_t)) exit(1);
-
-    // write auxi header
-    memset(&chunk, 0, sizeof(chunk_t));
-    strncpy(chunk.id, "auxi", 4);
-    chunk.size = sizeof(auxi_t);
-    if (fwrite(&chunk, 1, sizeof(chunk_t), file) != sizeof(chunk_t)) exit(1);
-
-    // write auxi data
-    memset(&auxi, 0, sizeof(auxi_t));
-    auxi.frequency = frequency;
-    set_datetime(&auxi.start_time);
-    if (fwrite(&auxi, 1, sizeof(auxi_t), file) != sizeof(auxi_t)) exit(1);
-
-    // write data header
-    strncpy(chunk.id, "data", 4);
-    chunk.size = -1;
-    if (fwrite(&chunk, 1, sizeof(chunk_t), file) != sizeof(chunk_t)) exit(1);
+	static const char *suffixes[] = {SIGMF_DATA_SUFFIX, SIGMF_META_SUFFIX, ".sigmf"};
+	size_t n, i;
+
+	snprintf(base, len, "%s", path);
+	n = strlen(base);
+	for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+		size_t k = strlen(suffixes[i]);
+		if (n > k && strcmp(base + n - k, suffixes[i]) == 0) {
+			base[n - k] = '\0';
+			return;
+		}
+	}
 }
 
-float db(float x)
+/* open a file, write its header and start its writer thread */
+static struct recording *recording_open(const char *path)
 {
-    return 10 * logf(x);    
+	struct recording *rec = calloc(1, sizeof(*rec));
+	/* room for the path and any sidecar suffix after it */
+	char sidecar[sizeof(rec->path) + 16], base[sizeof(rec->path)];
+
+	if (snprintf(rec->path, sizeof(rec->path), "%s", path) >= (int)sizeof(rec->path)) {
+		fprintf(stderr, "Filename %s is too long\n", path);
+		free(rec);
+		return NULL;
+	}
+	if (sigmf_bits) {
+		if (strcmp(path, "-") == 0) {
+			fprintf(stderr, "SigMF output needs a filename\n");
+			free(rec);
+			return NULL;
+		}
+		sigmf_base(base, sizeof(base), path);
+		/* the metadata suffix is as long as the data one */
+		if (snprintf(rec->path, sizeof(rec->path), "%s%s", base, SIGMF_DATA_SUFFIX)
+		    >= (int)sizeof(rec->path)) {
+			fprintf(stderr, "Filename %s is too long\n", path);
+			free(rec);
+			return NULL;
+		}
+		path = rec->path;
+	}
+	if(strcmp(path, "-") == 0) { /* Write samples to stdout */
+		rec->file = stdout;
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+	} else {
+		rec->file = fopen(path, "wb");
+		if (!rec->file) {
+			fprintf(stderr, "Failed to open %s\n", path);
+			free(rec);
+			return NULL;
+		}
+	}
+
+        //////////////////////////////////////////
+
+	/* a SigMF data file is bare samples */
+	if (sigmf_bits)
+		;
+	else if (ring_file_seconds > 0)
+		wave_header_ring(rec->file, samp_rate, frequency,
+			(uint64_t)(ring_file_seconds * samp_rate) * 2);
+	else
+		wave_header(rec->file, samp_rate, frequency, 8);
+
+        //////////////////////////////////////////
+
+	writer_init(&rec->writer, rec->file, &pool);
+	if (sigmf_bits) {
+		if (sigmf_open(&rec->sigmf, base, sigmf_bits, samp_rate, frequency, hw) < 0) {
+			recording_close(rec);
+			return NULL;
+		}
+		writer_sigmf(&rec->writer, &rec->sigmf, sigmf_bits);
+	}
+	if (ring_file_seconds > 0 &&
+	    writer_ring(&rec->writer, (uint64_t)(ring_file_seconds * samp_rate) * 2) < 0) {
+		recording_close(rec);
+		return NULL;
+	}
+	if (adaptive)
+		writer_adaptive(&rec->writer, MAXIMAL_BUF_LENGTH, latency_ms);
+	/* the offsets of a circular capture wrap round its region */
+	if (writeback_window && !rec->writer.ring_region)
+		writer_writeback(&rec->writer, writeback_window, writeback_keep);
+	if (write_align && !rec->writer.ring_region &&
+	    writer_align(&rec->writer, write_align) < 0) {
+		recording_close(rec);
+		return NULL;
+	}
+	/* a circular capture has fixed sizes and reuses its offsets */
+	if (header_seconds >= 0 && !rec->writer.ring_region)
+		writer_live_header(&rec->writer, header_seconds);
+	if (index_every && rec->file != stdout && !rec->writer.ring_region) {
+		snprintf(sidecar, sizeof(sidecar), "%s%s", rec->path, INDEX_SUFFIX);
+		if (index_open(&rec->index, sidecar, index_every, samp_rate, frequency) == 0)
+			rec->writer.index = &rec->index;
+	}
+	if (checksums && rec->file != stdout && !rec->writer.ring_region) {
+		snprintf(sidecar, sizeof(sidecar), "%s%s", rec->path, CHECKSUM_SUFFIX);
+		if (checksum_open(&rec->checksum, sidecar, rec->writer.data_offset) == 0)
+			rec->writer.checksum = &rec->checksum;
+	}
+	if (overviews && rec->file != stdout && !rec->writer.ring_region &&
+	    overview_open(&rec->overview, path, samp_rate, frequency) == 0)
+		rec->writer.overview = &rec->overview;
+	/* in sync mode the capture thread only reads, the writer
+	 * thread does everything else */
+	if (sync_mode)
+		rec->writer.process = sync_process;
+	if (writer_start(&rec->writer, cpus[CPU_WRITER]) < 0) {
+		recording_close(rec);
+		return NULL;
+	}
+	return rec;
 }
 
-int interval_seconds = 2; 
+/* hand the capture to another recording, or none, at the next block
+ * boundary; returns the recording it replaced through old */
+static int recording_switch(struct recording *next, struct recording **old)
+{
+	struct timespec ts;
+	int r = 0;
+
+	pthread_mutex_lock(&switch_lock);
+	*old = recording;
+	pending = next;
+	__atomic_store_n(&switch_pending, 1, __ATOMIC_RELEASE);
+	while (switch_pending && !do_exit) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_nsec += 100000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&switch_done, &switch_lock, &ts);
+	}
+	/* the capture is stopping, nothing was switched */
+	if (switch_pending) {
+		switch_pending = 0;
+		r = -1;
+	}
+	pthread_mutex_unlock(&switch_lock);
+	return r;
+}
+
+/* write the last seconds of the ring to path, or to a file named
+ * after the dump prefix and the time of the first sample */
+static void ring_dump(double seconds, const char *path)
+{
+	struct timespec ts;
+	struct tm tm;
+	auxi_t auxi;
+	FILE *file;
+	uint8_t *buf;
+	uint64_t head = ring_head(&ring), len, done = 0;
+	int64_t start_ns;
+	char name[1024], stamp[32];
+	time_t t;
+	size_t n;
+
+	len = (uint64_t)(seconds * samp_rate) * 2;
+	if (len > head)
+		len = head;
+	if (len > ring.size - MAXIMAL_BUF_LENGTH)
+		len = ring.size - MAXIMAL_BUF_LENGTH;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	start_ns = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec
+		- (int64_t)(len / 2) * 1000000000 / samp_rate;
+	if (!path) {
+		t = start_ns / 1000000000;
+		gmtime_r(&t, &tm);
+		strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", &tm);
+		snprintf(name, sizeof(name), "%s-%s.wav", dump_prefix, stamp);
+		path = name;
+	}
+	file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "WARNING: Failed to open %s for a dump.\n", path);
+		return;
+	}
+	memset(&auxi, 0, sizeof(auxi));
+	auxi.frequency = frequency;
+	set_datetime_ns(&auxi.start_time, start_ns);
+	wave_header_auxi(file, samp_rate, 8, &auxi);
+
+	buf = malloc(DUMP_CHUNK);
+	while (done < len) {
+		n = len - done < DUMP_CHUNK ? len - done : DUMP_CHUNK;
+		if (ring_read(&ring, head - len + done, buf, n) < 0) {
+			fprintf(stderr, "WARNING: Dump fell behind the capture, %s is cut short.\n", path);
+			break;
+		}
+		if (fwrite(buf, 1, n, file) != n) {
+			fprintf(stderr, "WARNING: Short write, %s is cut short.\n", path);
+			break;
+		}
+		done += n;
+	}
+	fflush(file);
+	wave_update_sizes(fileno(file), done);
+	fclose(file);
+	free(buf);
+	fprintf(stderr, "Dumped %.1f s to %s\n", done / 2.0 / samp_rate, path);
+}
+
+static void *dump_main(void *arg)
+{
+	double seconds;
+	char path[1024];
+
+	verbose_cpu_affinity("dump", cpus[CPU_ANALYSIS]);
+	while (1) {
+		if (sem_wait(&dump_sem) < 0)
+			continue;
+		if (dump_stop)
+			break;
+		/* a signal dumps the whole ring under the prefix */
+		pthread_mutex_lock(&dump_lock);
+		seconds = ring_seconds;
+		path[0] = '\0';
+		if (dump_queued) {
+			seconds = dump_seconds;
+			snprintf(path, sizeof(path), "%s", dump_path);
+			dump_queued = 0;
+		}
+		pthread_mutex_unlock(&dump_lock);
+		ring_dump(seconds, path[0] ? path : NULL);
+	}
+	return NULL;
+}
+
+/* a tuning change in progress */
+struct tuning {
+	uint64_t sample;	/* stream sample when the change was asked for */
+	uint64_t start;		/* and the time */
+	uint64_t us;		/* how long the device took */
+};
+
+static void tuning_begin(struct tuning *t)
+{
+	t->start = metrics_now();
+	t->sample = sample_now();
+}
+
+/* mark the change in the recording, the samples from the request to
+ * the settling time after the device took it are flagged as a region;
+ * freq is the new center frequency, 0 if it is unchanged */
+static void tuning_end(struct tuning *t, uint32_t freq, const char *label)
+{
+	char text[WAVE_LABEL];
+	uint64_t settle;
+
+	t->us = metrics_now() - t->start;
+	metrics_observe(H_RETUNE_TIME, t->us);
+	settle = (t->us + (uint64_t)settle_ms * 1000) * samp_rate / 1000000;
+	snprintf(text, sizeof(text), "%s, %.1f ms", label, t->us / 1e3);
+	if (recording)
+		writer_mark(&recording->writer, t->sample, settle, freq, text);
+}
+
+/* one command from the control socket, run by the control thread */
+static void control_command(char *line, char *reply, size_t len, void *ctx)
+{
+	struct recording *rec = recording, *old;
+	struct tuning change;
+	char label[WAVE_LABEL];
+	char *cmd = strtok(line, " \t");
+	char *arg = strtok(NULL, "");
+
+	while (arg && (*arg == ' ' || *arg == '\t'))
+		arg++;
+	if (!cmd) {
+		snprintf(reply, len, "ERR empty command");
+	} else if (strcmp(cmd, "start") == 0) {
+		if (!arg || !*arg) {
+			snprintf(reply, len, "ERR start needs a path");
+			return;
+		}
+		if (rec) {
+			snprintf(reply, len, "ERR already recording to %s", rec->path);
+			return;
+		}
+		rec = recording_open(arg);
+		if (!rec) {
+			snprintf(reply, len, "ERR cannot open %s", arg);
+		} else if (recording_switch(rec, &old) < 0) {
+			recording_close(rec);
+			snprintf(reply, len, "ERR capture stopped");
+		} else {
+			fprintf(stderr, "Recording to %s\n", rec->path);
+			snprintf(reply, len, "OK recording %s from sample %llu",
+				rec->path, (unsigned long long)switch_sample);
+		}
+	} else if (strcmp(cmd, "stop") == 0) {
+		if (!rec) {
+			snprintf(reply, len, "ERR not recording");
+			return;
+		}
+		if (recording_switch(NULL, &old) < 0) {
+			snprintf(reply, len, "ERR capture stopped");
+			return;
+		}
+		fprintf(stderr, "Stopped recording to %s\n", old->path);
+		snprintf(reply, len, "OK stopped at sample %llu",
+			(unsigned long long)switch_sample);
+		recording_close(old);
+	} else if (strcmp(cmd, "tune") == 0 && arg) {
+		uint32_t f = (uint32_t)atofs(arg);
+		tuning_begin(&change);
+		if (synth_mode)
+			synth_tune(&synth, f);
+		else if (verbose_set_frequency(dev, f) < 0) {
+			snprintf(reply, len, "ERR cannot tune to %u Hz", f);
+			return;
+		}
+		frequency = f;
+		bursts_tune(&bursts, f);
+		snprintf(label, sizeof(label), "tune %u Hz", f);
+		tuning_end(&change, f, label);
+		snprintf(reply, len, "OK tuned to %u Hz at sample %llu in %.1f ms", f,
+			(unsigned long long)change.sample, change.us / 1e3);
+	} else if (strcmp(cmd, "gain") == 0 && arg) {
+		tuning_begin(&change);
+		/* a synthetic source has no gain to set, only the label */
+		if (strcmp(arg, "auto") == 0) {
+			gain = 0;
+			if (!synth_mode)
+				verbose_auto_gain(dev);
+			snprintf(label, sizeof(label), "gain auto");
+		} else if (synth_mode) {
+			gain = (int)(atof(arg) * 10);
+			snprintf(label, sizeof(label), "gain %.1f dB", gain / 10.0);
+		} else {
+			gain = nearest_gain(dev, (int)(atof(arg) * 10));
+			verbose_gain_set(dev, gain);
+			snprintf(label, sizeof(label), "gain %.1f dB", gain / 10.0);
+		}
+		tuning_end(&change, 0, label);
+		snprintf(reply, len, "OK %s at sample %llu in %.1f ms", label,
+			(unsigned long long)change.sample, change.us / 1e3);
+	} else if (strcmp(cmd, "dump") == 0) {
+		char *seconds = arg ? strtok(arg, " \t") : NULL;
+		char *path = seconds ? strtok(NULL, "") : NULL;
+		if (!ring.mem) {
+			snprintf(reply, len, "ERR no ring, start with -W");
+			return;
+		}
+		pthread_mutex_lock(&dump_lock);
+		if (dump_queued) {
+			pthread_mutex_unlock(&dump_lock);
+			snprintf(reply, len, "ERR a dump is already queued");
+			return;
+		}
+		dump_seconds = seconds ? atof(seconds) : ring_seconds;
+		snprintf(dump_path, sizeof(dump_path), "%s", path ? path : "");
+		dump_queued = 1;
+		pthread_mutex_unlock(&dump_lock);
+		sem_post(&dump_sem);
+		snprintf(reply, len, "OK dumping %.1f s", dump_seconds);
+	} else if (strcmp(cmd, "sinks") == 0) {
+		char line[512];
+		int i;
+		snprintf(reply, len, "OK %d", nsinks);
+		for (i = 0; i < nsinks; i++) {
+			sink_report(&sinks[i], line, sizeof(line));
+			snprintf(reply + strlen(reply), len - strlen(reply), "; %s", line);
+		}
+	} else if (strcmp(cmd, "bursts") == 0) {
+		if (!bursts.running) {
+			snprintf(reply, len, "ERR no bursts, start with -X");
+			return;
+		}
+		snprintf(reply, len, "OK ");
+		bursts_report(&bursts, reply + 3, len - 3);
+	} else if (strcmp(cmd, "stats") == 0) {
+		snprintf(reply, len, "OK samples %llu dropped %llu frequency %u gain %.1f"
+			" recording %s bytes %llu failed %d",
+			(unsigned long long)metrics_counter(C_SAMPLES),
+			(unsigned long long)metrics_counter(C_DROPPED_SAMPLES),
+			frequency, gain / 10.0, rec ? rec->path : "-",
+			rec ? (unsigned long long)__atomic_load_n(&rec->writer.data_bytes, __ATOMIC_RELAXED) : 0ULL,
+			rec ? rec->writer.failed : 0);
+	} else {
+		snprintf(reply, len, "ERR commands are start path, stop, tune hz, gain db|auto,"
+			" dump [seconds [path]], stats, sinks, bursts");
+	}
+}
+
+static void parse_cpus(char *s)
+{
+	int i;
+	char *end;
+	for (i = 0; i < CPU_ROLES && *s; i++) {
+		if (*s != ',')
+			cpus[i] = (int)strtol(s, &end, 0);
+		else
+			end = s;
+		if (*end != ',')
+			break;
+		s = end + 1;
+	}
+}
 
-///////////////////////////////////
 
 
 int main(int argc, char **argv)
@@ -238,24 +813,35 @@ int main(int argc, char **argv)
 	struct sigaction sigact;
 #endif
 	char *filename = NULL;
+	char *metrics_spec = NULL;
+	char *control_path = NULL;
+	char *keep;
+	struct control control;
 	int n_read;
 	int r, opt;
-	int gain = 0;
 	int ppm_error = 0;
-	int sync_mode = 0;
-	FILE *file;
-	uint8_t *buffer;
+	int rt_priority = 0;
+	int lock_memory = 0;
+	struct block *block, *spare;
+	uint32_t buf_num = 0;
+	int pool_blocks = 0;
+	int gap = 0;
 	int dev_index = 0;
-	int dev_given = 0;
-	uint32_t frequency = 100000000;
-	uint32_t samp_rate = DEFAULT_SAMPLE_RATE;
+	char *dev_query = "0";
 	uint32_t out_block_size = DEFAULT_BUF_LENGTH;
+	char *sink_specs[SINK_MAX];
+	char *burst_spec = NULL;
+	int bursts_opened = 0, dump_started = 0;
+	int i;
+
+	startup_last = metrics_now();
+	memset(&control, 0, sizeof(control));
 
-	while ((opt = getopt(argc, argv, "d:f:g:s:b:n:p:S")) != -1) {
+	while ((opt = getopt(argc, argv, "d:f:g:s:b:B:Q:a:u:x:w:k:cPm:n:p:SM:R:A:LD:T:W:F:O:X:")) != -1) {
 		switch (opt) {
 		case 'd':
-			dev_index = verbose_device_search(optarg);
-			dev_given = 1;
+			dev_query = optarg;
+			synth_mode = strncmp(optarg, SYNTH_PREFIX, strlen(SYNTH_PREFIX)) == 0;
 			break;
 		case 'f':
 			frequency = (uint32_t)atofs(optarg);
@@ -272,22 +858,106 @@ int main(int argc, char **argv)
 		case 'b':
 			out_block_size = (uint32_t)atof(optarg);
 			break;
+		case 'B':
+			buf_num = (uint32_t)atoi(optarg);
+			break;
+		case 'Q':
+			pool_blocks = atoi(optarg);
+			break;
+		case 'a':
+			adaptive = 1;
+			latency_ms = atoi(optarg);
+			break;
+		case 'u':
+			header_seconds = atoi(optarg);
+			break;
+		case 'x':
+			index_every = (uint32_t)atoi(optarg);
+			break;
+		case 'c':
+			checksums = 1;
+			break;
+		case 'P':
+			overviews = 1;
+			break;
+		case 'w':
+			writeback_window = (uint64_t)atofb(strtok(optarg, ","));
+			keep = strtok(NULL, ",");
+			writeback_keep = keep ? (uint64_t)atofb(keep) : writeback_window * 4;
+			break;
+		case 'k':
+			write_align = (uint32_t)atofb(optarg);
+			break;
+		case 'm':
+			if (strncmp(optarg, "ci8", 3) == 0)
+				sigmf_bits = 8;
+			else if (strncmp(optarg, "ci16", 4) == 0)
+				sigmf_bits = 16;
+			else if (strncmp(optarg, "cf32", 4) == 0)
+				sigmf_bits = 32;
+			else
+				usage();
+			break;
 		case 'n':
 			bytes_to_read = (uint32_t)atof(optarg) * 2;
 			break;
 		case 'S':
 			sync_mode = 1;
 			break;
+		case 'M':
+			metrics_spec = optarg;
+			break;
+		case 'R':
+			rt_priority = atoi(optarg);
+			break;
+		case 'A':
+			parse_cpus(optarg);
+			break;
+		case 'L':
+			lock_memory = 1;
+			break;
+		case 'D':
+			control_path = optarg;
+			daemon_mode = 1;
+			break;
+		case 'T':
+			settle_ms = atoi(optarg);
+			break;
+		case 'W':
+			ring_seconds = atof(optarg);
+			break;
+		case 'F':
+			ring_file_seconds = atof(optarg);
+			break;
+		case 'O':
+			if (nsinks == SINK_MAX) {
+				fprintf(stderr, "At most %d extra outputs.\n", SINK_MAX);
+				exit(1);
+			}
+			sink_specs[nsinks++] = optarg;
+			break;
+		case 'X':
+			burst_spec = optarg;
+			break;
 		default:
 			usage();
 			break;
 		}
 	}
 
-	if (argc <= optind) {
-		usage();
-	} else {
+	if (argc > optind) {
 		filename = argv[optind];
+	} else if (!daemon_mode && !ring_seconds && !nsinks && !burst_spec) {
+		usage();
+	}
+
+	/* the WAVE header, its seek index and a circular file have no
+	 * place in a SigMF recording */
+	if (sigmf_bits && (header_seconds >= 0 || index_every || ring_file_seconds > 0)) {
+		fprintf(stderr, "WARNING: -u, -x and -F do not apply to SigMF output.\n");
+		header_seconds = -1;
+		index_every = 0;
+		ring_file_seconds = 0;
 	}
 
 	if(out_block_size < MINIMAL_BUF_LENGTH ||
@@ -301,20 +971,42 @@ int main(int argc, char **argv)
 		out_block_size = DEFAULT_BUF_LENGTH;
 	}
 
-	buffer = malloc(out_block_size * sizeof(uint8_t));
-
-	if (!dev_given) {
-		dev_index = verbose_device_search("0");
-	}
-
-	if (dev_index < 0) {
+	if (metrics_spec && metrics_start(metrics_spec, interval_seconds) < 0) {
 		exit(1);
 	}
 
-	r = rtlsdr_open(&dev, (uint32_t)dev_index);
-	if (r < 0) {
-		fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dev_index);
+	if (!pool_blocks)
+		pool_blocks = DEFAULT_POOL_BLOCKS;
+	if (pool_blocks < 3)
+		pool_blocks = 3;
+	if (pool_init(&pool, pool_blocks, out_block_size) < 0)
 		exit(1);
+	/* somewhere for the sync loop to read into when the pool runs dry */
+	spare = pool_get(&pool);
+
+	startup_phase("setup");
+
+	if (synth_mode) {
+		if (synth_open(&synth, dev_query, samp_rate, frequency) < 0)
+			exit(1);
+		r = 0;
+		snprintf(hw, sizeof(hw), "rtl_wave synthetic source");
+		startup_phase("open");
+	} else {
+		dev_index = verbose_device_search(dev_query);
+		if (dev_index < 0) {
+			exit(1);
+		}
+		startup_phase("search");
+
+		r = rtlsdr_open(&dev, (uint32_t)dev_index);
+		if (r < 0) {
+			fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dev_index);
+			exit(1);
+		}
+		startup_phase("open");
+		snprintf(hw, sizeof(hw), "%s SN %s", rtlsdr_get_device_name((uint32_t)dev_index),
+			device_serial(dev_index));
 	}
 #ifndef _WIN32
 	sigact.sa_handler = sighandler;
@@ -324,115 +1016,191 @@ int main(int argc, char **argv)
 	sigaction(SIGTERM, &sigact, NULL);
 	sigaction(SIGQUIT, &sigact, NULL);
 	sigaction(SIGPIPE, &sigact, NULL);
+	sem_init(&dump_sem, 0, 0);
+	if (ring_seconds > 0) {
+		sigact.sa_handler = dump_signal;
+		sigact.sa_flags = SA_RESTART;
+		sigaction(SIGUSR1, &sigact, NULL);
+	}
 #else
 	SetConsoleCtrlHandler( (PHANDLER_ROUTINE) sighandler, TRUE );
 #endif
-	/* Set the sample rate */
-	verbose_set_sample_rate(dev, samp_rate);
-
-	/* Set the frequency */
-	verbose_set_frequency(dev, frequency);
+	/* a synthetic source takes any rate and frequency as they are */
+	if (!synth_mode) {
+		/* Set the sample rate */
+		verbose_set_sample_rate(dev, samp_rate);
+		startup_phase("rate");
+
+		/* Set the frequency */
+		verbose_set_frequency(dev, frequency);
+		startup_phase("tune");
+
+		if (0 == gain) {
+			 /* Enable automatic gain */
+			verbose_auto_gain(dev);
+		} else {
+			/* Enable manual gain */
+			gain = nearest_gain(dev, gain);
+			verbose_gain_set(dev, gain);
+		}
 
-	if (0 == gain) {
-		 /* Enable automatic gain */
-		verbose_auto_gain(dev);
-	} else {
-		/* Enable manual gain */
-		gain = nearest_gain(dev, gain);
-		verbose_gain_set(dev, gain);
+		verbose_ppm_set(dev, ppm_error);
+		startup_phase("gain");
 	}
 
-	verbose_ppm_set(dev, ppm_error);
+	for (i = 0; i < nsinks; i++) {
+		if (sink_open(&sinks[i], sink_specs[i], &pool, samp_rate, frequency) < 0 ||
+		    sink_start(&sinks[i], cpus[CPU_WRITER]) < 0) {
+			nsinks = i;
+			r = -1;
+			goto out;
+		}
+	}
 
-	if(strcmp(filename, "-") == 0) { /* Write samples to stdout */
-		file = stdout;
-#ifdef _WIN32
-		_setmode(_fileno(stdin), _O_BINARY);
-#endif
+	if (ring_seconds > 0) {
+		if (ring_init(&ring, (size_t)(ring_seconds * samp_rate) * 2 + MAXIMAL_BUF_LENGTH) < 0) {
+			r = -1;
+			goto out;
+		}
+		if (filename)
+			dump_prefix = filename;
+		pthread_create(&dump_thread, NULL, dump_main, NULL);
+		dump_started = 1;
 	} else {
-		file = fopen(filename, "wb");
-		if (!file) {
-			fprintf(stderr, "Failed to open %s\n", filename);
+		if (burst_spec && ring_init(&ring,
+		    (size_t)BURST_RING_SECONDS * samp_rate * 2 + MAXIMAL_BUF_LENGTH) < 0) {
+			r = -1;
+			goto out;
+		}
+		if (filename) {
+			recording = recording_open(filename);
+			if (!recording) {
+				r = -1;
+				goto out;
+			}
+		}
+	}
+	if (burst_spec) {
+		if (bursts_open(&bursts, burst_spec, &ring, samp_rate, frequency) < 0) {
+			r = -1;
+			goto out;
+		}
+		bursts_opened = 1;
+		if (bursts_start(&bursts, cpus[CPU_ANALYSIS]) < 0) {
+			r = -1;
 			goto out;
 		}
 	}
 
+	/* before this thread goes real-time and pinned, which the control
+	 * thread and the writers it starts would inherit */
+	if (control_path && control_start(&control, control_path, control_command, NULL) < 0) {
+		r = -1;
+		goto out;
+	}
 
-        //////////////////////////////////////////
-
-        int interval = 0;
-        float ipeak = 0, qpeak = 0;
-        float iavg = 0, qavg = 0;
-
-	wave_header(file, samp_rate, frequency, 8);
+	if (lock_memory) {
+		verbose_mlockall();
+		prefault(pool.mem, pool.mem_len);
+	}
 
-        //////////////////////////////////////////
+	if (rt_priority)
+		verbose_realtime(rt_priority);
+	verbose_cpu_affinity("capture", cpus[CPU_CAPTURE]);
 
+	startup_phase("file");
 
 	/* Reset endpoint before we start reading from it (mandatory) */
-	verbose_reset_buffer(dev);
+	if (!synth_mode) {
+		verbose_reset_buffer(dev);
+		startup_phase("reset");
+	}
 
 	if (sync_mode) {
+		/* this thread only reads, alternating between pool blocks,
+		 * while the writer thread does everything else */
 		fprintf(stderr, "Reading samples in sync mode...\n");
-		while (!do_exit) {
-			r = rtlsdr_read_sync(dev, buffer, out_block_size, &n_read);
+		while (!do_exit && !recording_failed()) {
+			if (recording_poll())
+				gap = 0;
+			block = recording || nsinks ? pool_get(&pool) : NULL;
+			if (!block)
+				block = spare;
+			if (synth_mode)
+				r = synth_read_sync(&synth, block->data, out_block_size, &n_read);
+			else
+				r = rtlsdr_read_sync(dev, block->data, out_block_size, &n_read);
 			if (r < 0) {
 				fprintf(stderr, "WARNING: sync read failed.\n");
+				if (block != spare)
+					pool_put(&pool, block);
 				break;
 			}
 
+			uint64_t arrival = block_arrived(n_read);
+
 			if ((bytes_to_read > 0) && (bytes_to_read < (uint32_t)n_read)) {
 				n_read = bytes_to_read;
 				do_exit = 1;
 			}
 
+			/* the block is converted later by the writer thread */
+			if (ring.mem) {
+				ring_push(&ring, block->data, n_read);
+				bursts_notify(&bursts);
+			}
 
-        //////////////////////////////////////////
-
-        for (int i=0; i < n_read; i += 2)
-        {
-            float ival = (float) (buffer[i] - 128) / 128;
-            float qval = (float) (buffer[i+1] - 128) / 128;
-            ival = ival * ival;
-            qval = qval * qval;
-            iavg += ival;
-            qavg += qval;
-            if (ival > ipeak) ipeak = ival;
-            if (qval > qpeak) qpeak = qval;
-        }
-
-        interval += n_read / 2;
-        if (interval > samp_rate * interval_seconds){
-            iavg /= interval;
-            qavg /= interval;
-            fprintf(stderr, "PEAK %5.1f | %5.1f dBFS   PAR %4.1f | %4.1f dB\n",
-                    db(ipeak), db(qpeak), db(ipeak / iavg), db(qpeak / qavg));
-            interval = 0;
-            ipeak = qpeak = iavg = qavg = 0; 
-        };
-
-        //////////////////////////////////////////
-
-
-			for (int n=0; n<n_read; n++) buffer[n] = buffer[n] - 128;
-
-			if (fwrite(buffer, 1, n_read, file) != (size_t)n_read) {
-				fprintf(stderr, "Short write, samples lost, exiting!\n");
-				break;
+			if (block == spare) {
+				if (recording || nsinks) {
+					if (!dropping)
+						fprintf(stderr, "Buffer pool exhausted, samples lost!\n");
+					dropping = gap = 1;
+					metrics_add(C_DROPPED_SAMPLES, n_read / 2);
+				}
+				samples_seen += n_read / 2;
+				/* dropped samples count towards -n as well */
+				if (bytes_to_read > 0)
+					bytes_to_read -= n_read;
+				continue;
+			}
+			dropping = 0;
+
+			block->len = n_read;
+			block->sample = samples_seen;
+			samples_seen += n_read / 2;
+			block->time = arrival;
+			block->flags = gap ? BLOCK_GAP : 0;
+			gap = 0;
+
+			/* the device timed out, carry on after a gap */
+			if ((uint32_t)n_read < out_block_size && !do_exit) {
+				fprintf(stderr, "Short read, samples lost!\n");
+				metrics_add(C_SHORT_READS, 1);
+				gap = 1;
 			}
 
-			if ((uint32_t)n_read < out_block_size) {
-				fprintf(stderr, "Short read, samples lost, exiting!\n");
-				break;
+			if (recording) {
+				writer_submit(&recording->writer, block);
+			} else {
+				/* no writer thread to convert it */
+				convert_u8(block->data, block->len);
+				sinks_submit(block);
+				pool_put(&pool, block);
 			}
 
 			if (bytes_to_read > 0)
 				bytes_to_read -= n_read;
+
+			metrics_observe(H_CALLBACK_TIME, metrics_now() - arrival);
 		}
 	} else {
 		fprintf(stderr, "Reading samples in async mode...\n");
-		r = rtlsdr_read_async(dev, rtlsdr_callback, (void *)file,
-				      0, out_block_size);
+		if (synth_mode)
+			r = synth_read_async(&synth, rtlsdr_callback, (void *)&pool,
+					     out_block_size);
+		else
+			r = rtlsdr_read_async(dev, rtlsdr_callback, (void *)&pool,
+					      buf_num, out_block_size);
 	}
 
 	if (do_exit)
@@ -440,11 +1208,33 @@ int main(int argc, char **argv)
 	else
 		fprintf(stderr, "\nLibrary error %d, exiting...\n", r);
 
-	if (file != stdout)
-		fclose(file);
-
-	rtlsdr_close(dev);
-	free (buffer);
 out:
+	control_stop(&control);
+
+	if (recording)
+		recording_close(recording);
+
+	/* after the recording, whose writer feeds them in sync mode */
+	for (i = 0; i < nsinks; i++)
+		sink_stop(&sinks[i]);
+
+	if (bursts_opened)
+		bursts_close(&bursts);
+
+	if (dump_started) {
+		dump_stop = 1;
+		sem_post(&dump_sem);
+		pthread_join(dump_thread, NULL);
+	}
+	if (ring.mem)
+		ring_free(&ring);
+
+	metrics_stop();
+
+	if (!synth_mode) {
+		forget_gains(dev);
+		rtlsdr_close(dev);
+	}
+	pool_free(&pool);
 	return r >= 0 ? r : -r;
 }
@@ -0,0 +1,289 @@
+/*
+ * rtl_wave_bench, times the per-sample kernels of rtl_wave
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "wave.h"
+#include "dsp.h"
+#include "synth.h"
+#include "demod.h"
+#include "resample.h"
+
+#define MINIMAL_BUF_LENGTH		512
+#define MAXIMAL_BUF_LENGTH		(256 * 16384)
+
+static double min_seconds = 0.2;
+static int cycle_fd = -1;
+static FILE *out_file;
+static int out_fd;
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rtl_wave_bench, times the rtl_wave sample kernels\n\n"
+		"Usage:\t[-t seconds per measurement (default: 0.2)]\n"
+		"\t[-o writer target (default: /dev/null)]\n\n"
+		"Prints one CSV row per kernel and block size:\n"
+		"kernel,block_size,calls,seconds,msps,bytes_per_cycle\n"
+		"bytes_per_cycle is empty when no cycle counter is available.\n\n");
+	exit(1);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void cycles_open(void)
+{
+#ifdef __linux__
+	struct perf_event_attr pe;
+	memset(&pe, 0, sizeof(pe));
+	pe.type = PERF_TYPE_HARDWARE;
+	pe.size = sizeof(pe);
+	pe.config = PERF_COUNT_HW_CPU_CYCLES;
+	pe.disabled = 1;
+	pe.exclude_kernel = 1;
+	pe.exclude_hv = 1;
+	cycle_fd = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+	if (cycle_fd < 0) {
+		fprintf(stderr, "WARNING: No cycle counter (%s), bytes/cycle not reported.\n",
+			strerror(errno));}
+#endif
+}
+
+static void cycles_start(void)
+{
+#ifdef __linux__
+	if (cycle_fd < 0) {
+		return;}
+	ioctl(cycle_fd, PERF_EVENT_IOC_RESET, 0);
+	ioctl(cycle_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+static uint64_t cycles_stop(void)
+{
+	uint64_t count = 0;
+#ifdef __linux__
+	if (cycle_fd < 0) {
+		return 0;}
+	ioctl(cycle_fd, PERF_EVENT_IOC_DISABLE, 0);
+	if (read(cycle_fd, &count, sizeof(count)) != sizeof(count)) {
+		count = 0;}
+#endif
+	return count;
+}
+
+/* the kernels, each processing one block of len bytes */
+
+static struct iq_stats stats;
+
+static void run_convert(uint8_t *buf, uint32_t len)
+{
+	convert_u8(buf, len);
+}
+
+static uint8_t *copy_dst;
+
+static void run_convert_copy(uint8_t *buf, uint32_t len)
+{
+	convert_copy(copy_dst, buf, len);
+}
+
+static void run_stats(uint8_t *buf, uint32_t len)
+{
+	stats_update(&stats, buf, len);
+}
+
+static struct synth synth;
+
+static void run_synth(uint8_t *buf, uint32_t len)
+{
+	synth_generate(&synth, buf, len);
+}
+
+static struct demod nbfm, wbfm;
+
+static void run_nbfm(uint8_t *buf, uint32_t len)
+{
+	int16_t *audio;
+	demod_block(&nbfm, buf, len, &audio);
+}
+
+static void run_wbfm(uint8_t *buf, uint32_t len)
+{
+	int16_t *audio;
+	demod_block(&wbfm, buf, len, &audio);
+}
+
+static struct resample resample;
+
+static void run_resample(uint8_t *buf, uint32_t len)
+{
+	int16_t *out;
+	resample_block(&resample, buf, len, &out);
+}
+
+static void run_wave_header(uint8_t *buf, uint32_t len)
+{
+	rewind(out_file);
+	wave_header(out_file, 2048000, 100000000, 8);
+}
+
+static void run_fwrite(uint8_t *buf, uint32_t len)
+{
+	/* keep a file target from growing without bound */
+	if (ftell(out_file) > (1 << 30)) {
+		rewind(out_file);}
+	if (fwrite(buf, 1, len, out_file) != len) {
+		fprintf(stderr, "Short write, exiting!\n");
+		exit(1);
+	}
+}
+
+static void run_write(uint8_t *buf, uint32_t len)
+{
+	if (lseek(out_fd, 0, SEEK_CUR) > (1 << 30)) {
+		lseek(out_fd, 0, SEEK_SET);}
+	if (write(out_fd, buf, len) != (ssize_t)len) {
+		fprintf(stderr, "Short write, exiting!\n");
+		exit(1);
+	}
+}
+
+struct kernel {
+	const char *name;
+	void (*run)(uint8_t *buf, uint32_t len);
+	int per_block; /* 0 when the cost does not depend on the block size */
+};
+
+static struct kernel kernels[] = {
+	{"convert_u8", run_convert, 1},
+	{"convert_copy", run_convert_copy, 1},
+	{"stats_update", run_stats, 1},
+	{"synth", run_synth, 1},
+	{"nbfm", run_nbfm, 1},
+	{"wbfm", run_wbfm, 1},
+	{"resample", run_resample, 1},
+	{"wave_header", run_wave_header, 0},
+	{"fwrite", run_fwrite, 1},
+	{"write", run_write, 1},
+};
+
+static void measure(struct kernel *k, uint8_t *buf, uint32_t len)
+{
+	uint64_t calls = 0, cycles;
+	double start, elapsed;
+	uint32_t bytes = k->per_block ? len : WAVE_HEADER_SIZE;
+
+	k->run(buf, len); /* warm up caches and page in the buffer */
+	cycles_start();
+	start = now();
+	do {
+		k->run(buf, len);
+		calls++;
+		elapsed = now() - start;
+	} while (elapsed < min_seconds);
+	cycles = cycles_stop();
+
+	printf("%s,%u,%llu,%.6f,%.3f,", k->name, bytes,
+		(unsigned long long)calls, elapsed,
+		calls * (bytes / 2) / elapsed / 1e6);
+	if (cycles) {
+		printf("%.4f", (double)calls * bytes / cycles);}
+	printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+	unsigned i;
+	uint32_t len;
+	uint8_t *buf;
+	char *target = "/dev/null";
+
+	while ((opt = getopt(argc, argv, "t:o:")) != -1) {
+		switch (opt) {
+		case 't':
+			min_seconds = atof(optarg);
+			break;
+		case 'o':
+			target = optarg;
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+
+	out_file = fopen(target, "wb");
+	if (!out_file) {
+		fprintf(stderr, "Failed to open %s\n", target);
+		exit(1);
+	}
+	out_fd = open(target, O_WRONLY);
+	if (out_fd < 0) {
+		fprintf(stderr, "Failed to open %s\n", target);
+		exit(1);
+	}
+
+	buf = malloc(MAXIMAL_BUF_LENGTH);
+	copy_dst = malloc(MAXIMAL_BUF_LENGTH);
+	for (len = 0; len < MAXIMAL_BUF_LENGTH; len++) {
+		buf[len] = rand();}
+
+	/* a tone and a chirp in noise, the usual test signal */
+	if (synth_open(&synth, "tone:100k:-10,chirp:-500k:500k:0.1:-10,snr:20", 2048000, 100000000) < 0) {
+		exit(1);}
+	if (demod_open(&nbfm, "nbfm@100k", 2048000) < 0 ||
+	    demod_open(&wbfm, "wbfm@100k", 2048000) < 0 ||
+	    resample_open(&resample, "192k", 2048000) < 0) {
+		exit(1);}
+
+	cycles_open();
+	printf("kernel,block_size,calls,seconds,msps,bytes_per_cycle\n");
+	for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		if (!kernels[i].per_block) {
+			measure(&kernels[i], buf, 0);
+			continue;
+		}
+		for (len = MINIMAL_BUF_LENGTH; len <= MAXIMAL_BUF_LENGTH; len *= 2) {
+			measure(&kernels[i], buf, len);}
+	}
+
+	fclose(out_file);
+	close(out_fd);
+	free(buf);
+	free(copy_dst);
+	return 0;
+}
@@ -0,0 +1,279 @@
+/*
+ * rtl_wave_play, replays an rtl_wave capture at its original rate
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "wave.h"
+#include "dsp.h"
+
+#define DEFAULT_BUF_LENGTH		(16 * 16384)
+
+static volatile int do_exit = 0;
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rtl_wave_play, replays an rtl_wave capture in real time\n\n"
+		"Usage:\trtl_wave_play [options] capture.wav\n"
+		"\t[-o output, a path (file or fifo), tcp:port or '-' (default: -)]\n"
+		"\t[-r rate scale (default: 1.0)]\n"
+		"\t[-b block size in bytes (default: 16 * 16384)]\n"
+		"\t[-l loop forever]\n"
+		"\t[-w start the output with a WAVE header]\n"
+		"\t[-U emit offset binary samples like rtl_sdr]\n\n");
+	exit(1);
+}
+
+static void sighandler(int signum)
+{
+	do_exit = 1;
+}
+
+static int64_t ts_ns(struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static int open_output(char *spec)
+{
+	int fd, listener, on = 1;
+	struct sockaddr_in addr;
+
+	if (strcmp(spec, "-") == 0) {
+		return STDOUT_FILENO;}
+	if (strncmp(spec, "tcp:", 4) != 0) {
+		/* opening a fifo waits here for a reader */
+		fd = open(spec, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			fprintf(stderr, "Failed to open %s\n", spec);}
+		return fd;
+	}
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(atoi(spec + 4));
+	if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(listener, 1) < 0) {
+		fprintf(stderr, "Failed to listen on %s\n", spec);
+		return -1;
+	}
+	fprintf(stderr, "Waiting for a client on %s...\n", spec);
+	fd = accept(listener, NULL, NULL);
+	close(listener);
+	return fd;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len)
+{
+	ssize_t r;
+	while (len) {
+		r = write(fd, buf, len);
+		if (r < 0 && errno == EINTR) {
+			continue;}
+		if (r <= 0) {
+			return -1;}
+		buf += r;
+		len -= r;
+	}
+	return 0;
+}
+
+/* pacing error statistics */
+struct jitter {
+	int64_t min, max, sum;
+	uint64_t count, late;
+};
+
+static void jitter_report(struct jitter *j)
+{
+	if (!j->count) {
+		return;}
+	fprintf(stderr, "Pacing jitter %.1f / %.1f / %.1f us (min/mean/max), %llu late blocks\n",
+		j->min / 1e3, (double)j->sum / j->count / 1e3, j->max / 1e3,
+		(unsigned long long)j->late);
+	memset(j, 0, sizeof(*j));
+	j->min = INT64_MAX;
+}
+
+int main(int argc, char **argv)
+{
+	struct sigaction sigact;
+	struct wave_info info;
+	struct timespec ts;
+	struct jitter jitter;
+	char *output = "-";
+	double scale = 1.0;
+	uint32_t block_size = DEFAULT_BUF_LENGTH;
+	int loop = 0, header = 0, unsigned_out = 0;
+	int opt, in, out;
+	uint8_t *buf;
+	uint64_t pos;
+	int64_t start, deadline, late, next_report;
+	double ns_per_byte;
+	ssize_t n;
+	FILE *hdr;
+	auxi_t auxi;
+	int status = 0;
+
+	while ((opt = getopt(argc, argv, "o:r:b:lwU")) != -1) {
+		switch (opt) {
+		case 'o':
+			output = optarg;
+			break;
+		case 'r':
+			scale = atof(optarg);
+			break;
+		case 'b':
+			block_size = (uint32_t)atof(optarg);
+			break;
+		case 'l':
+			loop = 1;
+			break;
+		case 'w':
+			header = 1;
+			break;
+		case 'U':
+			unsigned_out = 1;
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+	if (argc <= optind || scale <= 0 || !block_size) {
+		usage();}
+
+	in = open(argv[optind], O_RDONLY);
+	if (in < 0 || wave_read_header(in, &info) < 0) {
+		fprintf(stderr, "Failed to read WAVE file %s\n", argv[optind]);
+		exit(1);
+	}
+	if (!info.data_size) {
+		fprintf(stderr, "No samples in %s\n", argv[optind]);
+		exit(1);
+	}
+	/* offset binary is only a thing of 8 bit samples */
+	if (unsigned_out && info.fmt.bits_per_sample != 8) {
+		fprintf(stderr, "-U needs 8 bit samples, %s has %u bits.\n", argv[optind],
+			info.fmt.bits_per_sample);
+		exit(1);
+	}
+	/* whole frames, at least one */
+	block_size -= block_size % info.fmt.block_size;
+	if (!block_size) {
+		block_size = info.fmt.block_size;}
+	fprintf(stderr, "%u S/s, %u bits, %llu bytes of samples", info.fmt.samples_per_sec,
+		info.fmt.bits_per_sample, (unsigned long long)info.data_size);
+	if (info.has_auxi) {
+		fprintf(stderr, ", tuned to %u Hz", info.auxi.frequency);}
+	fprintf(stderr, ".\n");
+
+	sigact.sa_handler = sighandler;
+	sigemptyset(&sigact.sa_mask);
+	sigact.sa_flags = 0;
+	sigaction(SIGINT, &sigact, NULL);
+	sigaction(SIGTERM, &sigact, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	out = open_output(output);
+	if (out < 0) {
+		exit(1);}
+	if (header) {
+		/* the source's fmt, be it I/Q or demodulated audio */
+		memset(&auxi, 0, sizeof(auxi));
+		auxi.frequency = info.has_auxi ? info.auxi.frequency : 0;
+		set_datetime(&auxi.start_time);
+		hdr = fdopen(dup(out), "wb");
+		wave_header_channels(hdr, info.fmt.samples_per_sec * scale, info.fmt.channels,
+			info.fmt.bits_per_sample, &auxi);
+		fclose(hdr);
+	}
+
+	buf = malloc(block_size);
+	ns_per_byte = 1e9 / ((double)info.fmt.samples_per_sec * info.fmt.block_size * scale);
+	memset(&jitter, 0, sizeof(jitter));
+	jitter.min = INT64_MAX;
+
+	/* every deadline is computed from the start, so errors never add up */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	start = ts_ns(&ts);
+	next_report = start + 10 * (int64_t)1000000000;
+	deadline = start;
+	pos = 0;
+	while (!do_exit) {
+		uint64_t offset = pos % info.data_size;
+		uint64_t len = info.data_size - offset;
+		if (!loop && pos >= info.data_size) {
+			break;}
+		if (len > block_size) {
+			len = block_size;}
+		n = pread(in, buf, len, info.data_offset + offset);
+		if (n <= 0) {
+			fprintf(stderr, "Read error, exiting!\n");
+			status = 1;
+			break;
+		}
+		if (unsigned_out) {
+			convert_u8(buf, n);}
+
+		ts.tv_sec = deadline / 1000000000;
+		ts.tv_nsec = deadline % 1000000000;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !do_exit);
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		late = ts_ns(&ts) - deadline;
+		if (late < jitter.min) {
+			jitter.min = late;}
+		if (late > jitter.max) {
+			jitter.max = late;}
+		if (late > (int64_t)(n * ns_per_byte)) {
+			jitter.late++;}
+		jitter.sum += late;
+		jitter.count++;
+
+		if (write_all(out, buf, n) < 0) {
+			fprintf(stderr, "Short write, exiting!\n");
+			status = 1;
+			break;
+		}
+		pos += n;
+		deadline = start + (int64_t)(pos * ns_per_byte);
+
+		if (ts_ns(&ts) >= next_report) {
+			jitter_report(&jitter);
+			next_report += 10 * (int64_t)1000000000;
+		}
+	}
+	jitter_report(&jitter);
+
+	free(buf);
+	close(in);
+	if (out != STDOUT_FILENO) {
+		close(out);}
+	return status;
+}
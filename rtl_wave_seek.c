@@ -0,0 +1,172 @@
+/*
+ * rtl_wave_seek, finds a moment of a capture through its seek index
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "index.h"
+#include "wave.h"
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rtl_wave_seek, finds a time in rtl_wave captures\n\n"
+		"Usage:\trtl_wave_seek time capture.wav.idx [more.idx ...]\n\n"
+		"time is UTC, as 'YYYY-MM-DD HH:MM:SS[.fff]', 'HH:MM:SS[.fff]'\n"
+		"on the day the first capture starts, or '@' unix seconds.\n"
+		"Prints the capture, the byte offset and the stream sample index.\n\n");
+	exit(1);
+}
+
+/* parse the time, a bare time of day is taken on the day of day_ns */
+static int parse_time(char *s, int64_t day_ns, int64_t *time_ns)
+{
+	struct tm tm;
+	char *rest;
+	double frac = 0;
+	time_t day;
+
+	if (s[0] == '@') {
+		*time_ns = (int64_t)(atof(s + 1) * 1e9);
+		return 0;
+	}
+	memset(&tm, 0, sizeof(tm));
+	rest = strptime(s, "%Y-%m-%d %H:%M:%S", &tm);
+	if (!rest) {
+		rest = strptime(s, "%Y-%m-%dT%H:%M:%S", &tm);}
+	if (!rest) {
+		day = day_ns / 1000000000;
+		gmtime_r(&day, &tm);
+		rest = strptime(s, "%H:%M:%S", &tm);
+	}
+	if (!rest) {
+		return -1;}
+	if (rest[0] == '.') {
+		frac = atof(rest);}
+	*time_ns = (int64_t)timegm(&tm) * 1000000000 + (int64_t)(frac * 1e9);
+	return 0;
+}
+
+struct capture {
+	char *path;
+	int fd;
+	int64_t count;
+	index_header_t header;
+	index_record_t first;
+};
+
+int main(int argc, char **argv)
+{
+	struct capture *caps, *cap = NULL;
+	index_record_t rec, next;
+	struct wave_info info;
+	int64_t time_ns, n, samples;
+	char data_path[1024];
+	int i, fd, ncaps;
+
+	if (argc < 3) {
+		usage();}
+
+	ncaps = argc - 2;
+	caps = calloc(ncaps, sizeof(struct capture));
+	for (i = 0; i < ncaps; i++) {
+		caps[i].path = argv[i + 2];
+		caps[i].fd = open(caps[i].path, O_RDONLY);
+		if (caps[i].fd < 0) {
+			fprintf(stderr, "Failed to open %s\n", caps[i].path);
+			exit(1);
+		}
+		caps[i].count = index_read_header(caps[i].fd, &caps[i].header);
+		if (caps[i].count < 0) {
+			fprintf(stderr, "%s is not an rtl_wave index\n", caps[i].path);
+			exit(1);
+		}
+		if (caps[i].count == 0 ||
+		    index_read_record(caps[i].fd, &caps[i].header, 0, &caps[i].first) < 0) {
+			caps[i].count = 0;}
+	}
+
+	if (parse_time(argv[1], caps[0].first.time_ns, &time_ns) < 0) {
+		fprintf(stderr, "Cannot parse time %s\n", argv[1]);
+		exit(1);
+	}
+
+	/* the capture that started last at or before the time */
+	for (i = 0; i < ncaps; i++) {
+		if (!caps[i].count || caps[i].first.time_ns > time_ns) {
+			continue;}
+		if (!cap || caps[i].first.time_ns > cap->first.time_ns) {
+			cap = &caps[i];}
+	}
+	if (!cap) {
+		fprintf(stderr, "No capture covers %s\n", argv[1]);
+		exit(1);
+	}
+
+	n = index_search(cap->fd, &cap->header, cap->count, time_ns);
+	if (n < 0 || index_read_record(cap->fd, &cap->header, n, &rec) < 0) {
+		fprintf(stderr, "Failed to read %s\n", cap->path);
+		exit(1);
+	}
+
+	snprintf(data_path, sizeof(data_path), "%s", cap->path);
+	i = strlen(data_path) - strlen(INDEX_SUFFIX);
+	if (i > 0 && strcmp(data_path + i, INDEX_SUFFIX) == 0) {
+		data_path[i] = '\0';}
+
+	/* step from the record at the sample rate, but never into the next
+	 * record's bytes; a time inside a gap resolves to the end of the gap */
+	samples = (time_ns - rec.time_ns) * (int64_t)cap->header.samp_rate / 1000000000;
+	if (n + 1 < cap->count &&
+	    index_read_record(cap->fd, &cap->header, n + 1, &next) == 0) {
+		int64_t written = (next.offset - rec.offset) / cap->header.block_size;
+		if (samples >= written) {
+			rec = next;
+			samples = 0;
+		}
+	} else {
+		/* the last record runs to the end of the data, a time
+		 * past it is after the capture, or between two segments */
+		fd = open(data_path, O_RDONLY);
+		if (fd < 0 || wave_read_header(fd, &info) < 0) {
+			fprintf(stderr, "Failed to read WAVE file %s\n", data_path);
+			exit(1);
+		}
+		close(fd);
+		if (rec.offset + (uint64_t)(samples + 1) * cap->header.block_size >
+		    info.data_offset + info.data_size) {
+			fprintf(stderr, "No capture covers %s\n", argv[1]);
+			exit(1);
+		}
+	}
+
+	printf("%s\t%llu\t%llu\n", data_path,
+		(unsigned long long)(rec.offset + samples * cap->header.block_size),
+		(unsigned long long)(rec.sample + samples));
+
+	for (i = 0; i < ncaps; i++) {
+		close(caps[i].fd);}
+	free(caps);
+	return 0;
+}
@@ -0,0 +1,314 @@
+/*
+ * rtl_wave_spectrogram, computes the spectrogram of a capture on all cores
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "wave.h"
+#include "dsp.h"
+#include "fft.h"
+#include "metrics.h"
+
+#define SPEC_MAGIC	"RWSG"
+#define SPEC_VERSION	1
+#define WINDOW		(16 << 20)	/* bytes each thread maps at a time */
+
+/* start of the binary output, followed by rows of bins float dBFS */
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t bins;		/* DC is bin bins / 2 */
+	uint32_t frames;	/* transforms averaged into each row */
+	uint32_t samp_rate;
+	uint32_t frequency;	/* center, from auxi */
+	int64_t start_ns;	/* unix time of the first row, from auxi */
+	double row_seconds;
+	uint64_t rows;
+} __attribute__((packed)) spec_header_t;
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rtl_wave_spectrogram, computes the spectrogram of a capture\n\n"
+		"Usage:\trtl_wave_spectrogram [options] capture.wav\n"
+		"\t[-o binary output of float dBFS rows]\n"
+		"\t[-p PGM image output]\n"
+		"\t[-n FFT size, a power of two (default: 1024)]\n"
+		"\t[-a transforms averaged per row (default: 64)]\n"
+		"\t[-l dBFS of black in the image (default: -100)]\n"
+		"\t[-h dBFS of white in the image (default: 0)]\n"
+		"\t[-j threads (default: one per cpu)]\n\n");
+	exit(1);
+}
+
+/* one finished row, row r lives in slots[r % nslots] */
+struct slot {
+	float *power;
+	int ready;
+};
+
+struct job {
+	int fd;
+	uint64_t data_offset;
+	uint64_t row_bytes;
+	int bits;
+	uint64_t nrows;
+	uint32_t frames;
+	struct fft fft;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint64_t next;		/* next row to hand out */
+	uint64_t written;	/* rows already in the output */
+	int nslots;
+	struct slot *slots;
+};
+
+static void process(struct job *job, const uint8_t *data, float *re, float *im, float *power)
+{
+	int n = job->fft.n, k;
+	uint64_t sample = 0;
+	uint32_t f;
+
+	memset(power, 0, n * sizeof(float));
+	for (f = 0; f < job->frames; f++, sample += n) {
+		if (job->bits == 8) {
+			deinterleave_s8((const int8_t *)data + 2 * sample, re, im, n);
+		} else {
+			deinterleave_s16((const int16_t *)data + 2 * sample, re, im, n);}
+		fft_power(&job->fft, re, im, power);
+	}
+	for (k = 0; k < n; k++) {
+		power[k] = power[k] ? 10 * log10f(power[k] / job->frames) : -200;}
+}
+
+static void *worker(void *arg)
+{
+	struct job *job = arg;
+	float *re = malloc(job->fft.n * sizeof(float));
+	float *im = malloc(job->fft.n * sizeof(float));
+	struct wave_window window;
+	const uint8_t *data;
+	uint64_t r;
+
+	memset(&window, 0, sizeof(window));
+
+	pthread_mutex_lock(&job->lock);
+	while (job->next < job->nrows) {
+		/* stay within the slots the writer has not caught up on */
+		if (job->next >= job->written + job->nslots) {
+			pthread_cond_wait(&job->cond, &job->lock);
+			continue;
+		}
+		r = job->next++;
+		pthread_mutex_unlock(&job->lock);
+
+		/* rows are handed out in order, so one window serves a
+		 * run of them before it slides on */
+		data = wave_window(&window, job->fd, job->data_offset + r * job->row_bytes,
+			job->row_bytes, WINDOW);
+		if (!data) {
+			fprintf(stderr, "Failed to map row %llu, exiting!\n", (unsigned long long)r);
+			exit(1);
+		}
+		process(job, data, re, im, job->slots[r % job->nslots].power);
+
+		pthread_mutex_lock(&job->lock);
+		job->slots[r % job->nslots].ready = 1;
+		pthread_cond_broadcast(&job->cond);
+	}
+	pthread_mutex_unlock(&job->lock);
+
+	wave_window_free(&window);
+	free(re);
+	free(im);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct wave_info info;
+	struct job job;
+	spec_header_t header;
+	pthread_t *threads;
+	FILE *out = NULL, *pgm = NULL;
+	char *out_path = NULL, *pgm_path = NULL;
+	uint8_t *pixels;
+	uint64_t r, start_us;
+	int opt, i, k, in, nfft = 1024, nthreads = 0;
+	float low = -100, high = 0;
+	double seconds;
+
+	memset(&job, 0, sizeof(job));
+	job.frames = 64;
+
+	while ((opt = getopt(argc, argv, "o:p:n:a:l:h:j:")) != -1) {
+		switch (opt) {
+		case 'o':
+			out_path = optarg;
+			break;
+		case 'p':
+			pgm_path = optarg;
+			break;
+		case 'n':
+			nfft = atoi(optarg);
+			break;
+		case 'a':
+			job.frames = atoi(optarg);
+			break;
+		case 'l':
+			low = atof(optarg);
+			break;
+		case 'h':
+			high = atof(optarg);
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+	if (argc <= optind || (!out_path && !pgm_path) || job.frames < 1 || high <= low) {
+		usage();}
+	if (fft_init(&job.fft, nfft) < 0) {
+		fprintf(stderr, "FFT size %d is not a power of two\n", nfft);
+		exit(1);
+	}
+	if (nthreads <= 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);}
+	if (nthreads <= 0) {
+		nthreads = 1;}
+
+	in = open(argv[optind], O_RDONLY);
+	if (in < 0 || wave_read_header(in, &info) < 0) {
+		fprintf(stderr, "Failed to read WAVE file %s\n", argv[optind]);
+		exit(1);
+	}
+	job.bits = info.fmt.bits_per_sample;
+	if (info.fmt.channels != 2 || info.fmt.format_tag != 1 ||
+	    (job.bits != 8 && job.bits != 16)) {
+		fprintf(stderr, "%s is not an 8 or 16 bit I/Q capture\n", argv[optind]);
+		exit(1);
+	}
+	job.fd = in;
+	job.data_offset = info.data_offset;
+	job.row_bytes = (uint64_t)job.frames * nfft * info.fmt.block_size;
+	job.nrows = info.data_size / job.row_bytes;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SPEC_MAGIC, 4);
+	header.version = SPEC_VERSION;
+	header.bins = nfft;
+	header.frames = job.frames;
+	header.samp_rate = info.fmt.samples_per_sec;
+	header.row_seconds = (double)job.frames * nfft / info.fmt.samples_per_sec;
+	header.rows = job.nrows;
+	if (info.has_auxi) {
+		header.frequency = info.auxi.frequency;
+		header.start_ns = datetime_ns(&info.auxi.start_time);
+	}
+
+	if (out_path) {
+		out = fopen(out_path, "wb");
+		if (!out || fwrite(&header, sizeof(header), 1, out) != 1) {
+			fprintf(stderr, "Failed to open %s\n", out_path);
+			exit(1);
+		}
+	}
+	if (pgm_path) {
+		pgm = fopen(pgm_path, "wb");
+		if (!pgm) {
+			fprintf(stderr, "Failed to open %s\n", pgm_path);
+			exit(1);
+		}
+		fprintf(pgm, "P5\n# %u Hz center, %u S/s, %.6f s per row\n%d %llu\n255\n",
+			header.frequency, header.samp_rate, header.row_seconds,
+			nfft, (unsigned long long)job.nrows);
+	}
+	pixels = malloc(nfft);
+
+	fprintf(stderr, "%llu rows of %d bins, %.3f s per row, on %d threads...\n",
+		(unsigned long long)job.nrows, nfft, header.row_seconds, nthreads);
+	start_us = metrics_now();
+
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
+	job.nslots = 4 * nthreads;
+	job.slots = calloc(job.nslots, sizeof(struct slot));
+	for (i = 0; i < job.nslots; i++) {
+		job.slots[i].power = malloc(nfft * sizeof(float));}
+	threads = calloc(nthreads, sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		pthread_create(&threads[i], NULL, worker, &job);}
+
+	/* write the rows back in order as they complete */
+	for (r = 0; r < job.nrows; r++) {
+		struct slot *slot = &job.slots[r % job.nslots];
+		pthread_mutex_lock(&job.lock);
+		while (!slot->ready) {
+			pthread_cond_wait(&job.cond, &job.lock);}
+		pthread_mutex_unlock(&job.lock);
+
+		if (out && fwrite(slot->power, sizeof(float), nfft, out) != (size_t)nfft) {
+			fprintf(stderr, "Short write, exiting!\n");
+			exit(1);
+		}
+		if (pgm) {
+			for (k = 0; k < nfft; k++) {
+				float v = (slot->power[k] - low) / (high - low) * 255;
+				pixels[k] = v < 0 ? 0 : (v > 255 ? 255 : v);
+			}
+			if (fwrite(pixels, 1, nfft, pgm) != (size_t)nfft) {
+				fprintf(stderr, "Short write, exiting!\n");
+				exit(1);
+			}
+		}
+
+		pthread_mutex_lock(&job.lock);
+		slot->ready = 0;
+		job.written++;
+		pthread_cond_broadcast(&job.cond);
+		pthread_mutex_unlock(&job.lock);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);}
+	if (out) {
+		fclose(out);}
+	if (pgm) {
+		fclose(pgm);}
+
+	seconds = (metrics_now() - start_us) / 1e6;
+	fprintf(stderr, "Done, %.1f MS/s.\n",
+		job.nrows * job.frames * nfft / seconds / 1e6);
+
+	for (i = 0; i < job.nslots; i++) {
+		free(job.slots[i].power);}
+	free(job.slots);
+	free(threads);
+	free(pixels);
+	fft_free(&job.fft);
+	close(in);
+	return 0;
+}
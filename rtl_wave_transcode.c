@@ -0,0 +1,345 @@
+/*
+ * rtl_wave_transcode, reprocesses rtl_wave captures on all cores
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "wave.h"
+#include "dsp.h"
+#include "metrics.h"
+
+#define DEFAULT_CHUNK	(1 << 20)	/* input samples per chunk */
+#define WINDOW		(16 << 20)	/* bytes each thread maps at a time */
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rtl_wave_transcode, reprocesses an 8 bit rtl_wave capture\n\n"
+		"Usage:\trtl_wave_transcode [options] input.wav output.wav\n"
+		"\t[-d decimation factor (default: 1)]\n"
+		"\t[-t filter taps, 0 for none (default: 16 * decimation + 1)]\n"
+		"\t[-c remove the DC offset]\n"
+		"\t[-e output bits, 8, 16 or 32 for float (default: 8)]\n"
+		"\t[-j threads (default: one per cpu)]\n"
+		"\t[-k samples per chunk (default: 1048576)]\n\n");
+	exit(1);
+}
+
+/* one chunk's output, chunk c lives in slots[c % nslots] */
+struct slot {
+	uint8_t *out;
+	size_t len;
+	int ready;
+};
+
+struct job {
+	int fd;
+	uint64_t data_offset;
+	uint64_t nsamples;
+	uint32_t chunk;
+	uint64_t nchunks;
+	int decim;
+	int ntaps;
+	float *taps;
+	int dc;
+	float dc_i, dc_q;	/* means of the whole capture */
+	int bits;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	uint64_t next;		/* next chunk to hand out */
+	uint64_t written;	/* chunks already in the output */
+	int nslots;
+	struct slot *slots;
+};
+
+static void process(struct job *job, uint64_t c, struct wave_window *window,
+	float *fi, float *fq, float *oi, float *oq, struct slot *slot)
+{
+	const int8_t *data;
+	int history = job->ntaps ? job->ntaps - 1 : 0;
+	int64_t start = (int64_t)(c * job->chunk) - history;
+	uint64_t end = (c + 1) * job->chunk;
+	uint32_t pad = 0, n, n_out;
+
+	if (end > job->nsamples) {
+		end = job->nsamples;}
+	/* the first chunk has no history, start it from silence */
+	if (start < 0) {
+		pad = -start;
+		memset(fi, 0, pad * sizeof(float));
+		memset(fq, 0, pad * sizeof(float));
+		start = 0;
+	}
+	n = pad + (end - start);
+	/* chunks are handed out in order, so one window serves a run
+	 * of them before it slides on */
+	data = (const int8_t *)wave_window(window, job->fd, job->data_offset + 2 * start,
+		2 * (end - start), WINDOW);
+	if (!data) {
+		fprintf(stderr, "Failed to map chunk %llu, exiting!\n", (unsigned long long)c);
+		exit(1);
+	}
+	deinterleave_s8(data, fi + pad, fq + pad, end - start);
+
+	/* one offset for the whole capture, the silence before it stays */
+	if (job->dc) {
+		remove_dc(fi + pad, end - start, job->dc_i);
+		remove_dc(fq + pad, end - start, job->dc_q);
+	}
+	if (job->ntaps) {
+		n_out = (n - history) / job->decim;
+		fir_decimate(fi, oi, n_out, job->taps, job->ntaps, job->decim);
+		fir_decimate(fq, oq, n_out, job->taps, job->ntaps, job->decim);
+	} else {
+		n_out = n;
+		oi = fi;
+		oq = fq;
+	}
+	interleave(oi, oq, slot->out, n_out, job->bits);
+	slot->len = (size_t)n_out * 2 * job->bits / 8;
+}
+
+/* the mean of each channel over the whole capture, so that every
+ * chunk subtracts the same offset */
+static int channel_means(struct job *job, int in, uint64_t offset)
+{
+	int8_t *buf = malloc(2 * DEFAULT_CHUNK);
+	int64_t sum_i = 0, sum_q = 0;
+	uint64_t done = 0;
+	ssize_t n, k;
+
+	if (!buf) {
+		return -1;}
+	while (done < job->nsamples) {
+		n = job->nsamples - done < DEFAULT_CHUNK ? job->nsamples - done : DEFAULT_CHUNK;
+		n = pread(in, buf, 2 * n, offset + 2 * done);
+		if (n < 2) {
+			free(buf);
+			return -1;
+		}
+		for (k = 0; k + 1 < n; k += 2) {
+			sum_i += buf[k];
+			sum_q += buf[k + 1];
+		}
+		done += n / 2;
+	}
+	free(buf);
+	if (job->nsamples) {
+		job->dc_i = (double)sum_i / job->nsamples / 128;
+		job->dc_q = (double)sum_q / job->nsamples / 128;
+	}
+	return 0;
+}
+
+static void *worker(void *arg)
+{
+	struct job *job = arg;
+	int history = job->ntaps ? job->ntaps - 1 : 0;
+	float *fi = malloc((job->chunk + history) * sizeof(float));
+	float *fq = malloc((job->chunk + history) * sizeof(float));
+	float *oi = malloc((job->chunk / job->decim + 1) * sizeof(float));
+	float *oq = malloc((job->chunk / job->decim + 1) * sizeof(float));
+	struct wave_window window;
+	uint64_t c;
+
+	memset(&window, 0, sizeof(window));
+
+	pthread_mutex_lock(&job->lock);
+	while (job->next < job->nchunks) {
+		/* stay within the slots the writer has not caught up on */
+		if (job->next >= job->written + job->nslots) {
+			pthread_cond_wait(&job->cond, &job->lock);
+			continue;
+		}
+		c = job->next++;
+		pthread_mutex_unlock(&job->lock);
+
+		process(job, c, &window, fi, fq, oi, oq, &job->slots[c % job->nslots]);
+
+		pthread_mutex_lock(&job->lock);
+		job->slots[c % job->nslots].ready = 1;
+		pthread_cond_broadcast(&job->cond);
+	}
+	pthread_mutex_unlock(&job->lock);
+
+	wave_window_free(&window);
+	free(fi);
+	free(fq);
+	free(oi);
+	free(oq);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct wave_info info;
+	struct job job;
+	auxi_t auxi;
+	pthread_t *threads;
+	FILE *out;
+	uint64_t c, bytes = 0, start_us;
+	int opt, i, in, nthreads = 0;
+	double seconds;
+
+	memset(&job, 0, sizeof(job));
+	job.decim = 1;
+	job.bits = 8;
+	job.chunk = DEFAULT_CHUNK;
+	job.ntaps = -1;
+
+	while ((opt = getopt(argc, argv, "d:t:ce:j:k:")) != -1) {
+		switch (opt) {
+		case 'd':
+			job.decim = atoi(optarg);
+			break;
+		case 't':
+			job.ntaps = atoi(optarg);
+			break;
+		case 'c':
+			job.dc = 1;
+			break;
+		case 'e':
+			job.bits = atoi(optarg);
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
+		case 'k':
+			job.chunk = (uint32_t)atof(optarg);
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+	if (argc - optind != 2 || job.decim < 1 ||
+	    (job.bits != 8 && job.bits != 16 && job.bits != 32)) {
+		usage();}
+	if (nthreads <= 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);}
+	if (nthreads <= 0) {
+		nthreads = 1;}
+	if (job.ntaps < 0) {
+		job.ntaps = 16 * job.decim + 1;}
+	if (job.ntaps < 1 && job.decim > 1) {
+		job.ntaps = 1;}
+	if (job.ntaps == 1 && job.decim == 1) {
+		job.ntaps = 0;}
+	/* chunks start on an output sample */
+	job.chunk -= job.chunk % job.decim;
+	if (job.chunk < (uint32_t)job.decim) {
+		job.chunk = job.decim;}
+
+	in = open(argv[optind], O_RDONLY);
+	if (in < 0 || wave_read_header(in, &info) < 0) {
+		fprintf(stderr, "Failed to read WAVE file %s\n", argv[optind]);
+		exit(1);
+	}
+	if (info.fmt.bits_per_sample != 8 || info.fmt.channels != 2) {
+		fprintf(stderr, "%s is not an 8 bit I/Q capture\n", argv[optind]);
+		exit(1);
+	}
+	job.fd = in;
+	job.data_offset = info.data_offset;
+	job.nsamples = info.data_size / 2;
+	job.nchunks = (job.nsamples + job.chunk - 1) / job.chunk;
+
+	if (job.dc && channel_means(&job, in, info.data_offset) < 0) {
+		fprintf(stderr, "Failed to read %s\n", argv[optind]);
+		exit(1);
+	}
+	if (job.dc) {
+		fprintf(stderr, "DC offset %.5f, %.5f of full scale.\n", job.dc_i, job.dc_q);}
+
+	if (job.ntaps) {
+		job.taps = malloc(job.ntaps * sizeof(float));
+		if (job.ntaps > 1) {
+			fir_lowpass(job.taps, job.ntaps, 0.45f / job.decim);
+		} else {
+			job.taps[0] = 1;}
+	}
+
+	out = fopen(argv[optind + 1], "wb");
+	if (!out) {
+		fprintf(stderr, "Failed to open %s\n", argv[optind + 1]);
+		exit(1);
+	}
+	if (info.has_auxi) {
+		auxi = info.auxi;
+	} else {
+		memset(&auxi, 0, sizeof(auxi));
+		set_datetime(&auxi.start_time);
+	}
+	wave_header_auxi(out, info.fmt.samples_per_sec / job.decim, job.bits, &auxi);
+
+	fprintf(stderr, "Transcoding %llu samples in %llu chunks on %d threads...\n",
+		(unsigned long long)job.nsamples, (unsigned long long)job.nchunks, nthreads);
+	start_us = metrics_now();
+
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.cond, NULL);
+	job.nslots = 2 * nthreads;
+	job.slots = calloc(job.nslots, sizeof(struct slot));
+	for (i = 0; i < job.nslots; i++) {
+		job.slots[i].out = malloc((size_t)job.chunk * 2 * job.bits / 8);}
+	threads = calloc(nthreads, sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		pthread_create(&threads[i], NULL, worker, &job);}
+
+	/* write the chunks back in order as they complete */
+	for (c = 0; c < job.nchunks; c++) {
+		struct slot *slot = &job.slots[c % job.nslots];
+		pthread_mutex_lock(&job.lock);
+		while (!slot->ready) {
+			pthread_cond_wait(&job.cond, &job.lock);}
+		pthread_mutex_unlock(&job.lock);
+
+		if (fwrite(slot->out, 1, slot->len, out) != slot->len) {
+			fprintf(stderr, "Short write, exiting!\n");
+			exit(1);
+		}
+		bytes += slot->len;
+
+		pthread_mutex_lock(&job.lock);
+		slot->ready = 0;
+		job.written++;
+		pthread_cond_broadcast(&job.cond);
+		pthread_mutex_unlock(&job.lock);
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);}
+	fflush(out);
+	wave_update_sizes(fileno(out), bytes);
+	fclose(out);
+
+	seconds = (metrics_now() - start_us) / 1e6;
+	fprintf(stderr, "Done, %.1f MS/s.\n", job.nsamples / seconds / 1e6);
+
+	for (i = 0; i < job.nslots; i++) {
+		free(job.slots[i].out);}
+	free(job.slots);
+	free(threads);
+	free(job.taps);
+	close(in);
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * rtl_wave_unring, turns a circular rtl_wave capture into a plain one
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "wave.h"
+
+#define COPY_CHUNK	(1 << 20)
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rtl_wave_unring, linearizes a circular rtl_wave capture\n\n"
+		"Usage:\trtl_wave_unring ring.wav output.wav\n\n"
+		"The output holds the samples from the oldest to the newest,\n"
+		"with the start time moved to the oldest sample kept.\n"
+		"The capture may still be running.\n\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct wave_info info;
+	auxi_t auxi;
+	FILE *out;
+	uint8_t *buf;
+	uint64_t region, written, len, start, done = 0, now;
+	ssize_t n;
+	int in;
+
+	if (argc != 3) {
+		usage();}
+
+	in = open(argv[1], O_RDONLY);
+	if (in < 0 || wave_read_header(in, &info) < 0) {
+		fprintf(stderr, "Failed to read WAVE file %s\n", argv[1]);
+		exit(1);
+	}
+	if (!info.has_ring || !info.ring.region) {
+		fprintf(stderr, "%s is not a circular capture\n", argv[1]);
+		exit(1);
+	}
+	region = info.ring.region;
+	written = info.ring.written;
+	len = written < region ? written : region;
+	start = written - len;
+
+	out = fopen(argv[2], "wb");
+	if (!out) {
+		fprintf(stderr, "Failed to open %s\n", argv[2]);
+		exit(1);
+	}
+	auxi = info.auxi;
+	if (info.has_auxi && start) {
+		set_datetime_ns(&auxi.start_time, datetime_ns(&info.auxi.start_time) +
+			(int64_t)(start / info.fmt.block_size) * 1000000000 / info.fmt.samples_per_sec);
+	}
+	wave_header_auxi(out, info.fmt.samples_per_sec, info.fmt.bits_per_sample, &auxi);
+
+	/* oldest first, from the head round to the head */
+	buf = malloc(COPY_CHUNK);
+	while (done < len) {
+		uint64_t at = (start + done) % region;
+		uint64_t piece = len - done;
+		if (piece > COPY_CHUNK) {
+			piece = COPY_CHUNK;}
+		if (piece > region - at) {
+			piece = region - at;}
+		n = pread(in, buf, piece, info.data_offset + at);
+		if (n <= 0) {
+			fprintf(stderr, "Read error, exiting!\n");
+			exit(1);
+		}
+		if (fwrite(buf, 1, n, out) != (size_t)n) {
+			fprintf(stderr, "Short write, exiting!\n");
+			exit(1);
+		}
+		done += n;
+	}
+	fflush(out);
+	wave_update_sizes(fileno(out), done);
+	fclose(out);
+
+	/* a running capture may have lapped the start while it was copied */
+	if (pread(in, &now, sizeof(now), WAVE_RING_WRITTEN_OFFSET) == sizeof(now) &&
+	    now > start + region) {
+		uint64_t lost = now - region - start;
+		fprintf(stderr, "WARNING: %llu bytes at the start were overwritten while copying.\n",
+			(unsigned long long)(lost < len ? lost : len));
+	}
+	fprintf(stderr, "%llu bytes, %.1f s, from %s\n", (unsigned long long)done,
+		(double)done / info.fmt.block_size / info.fmt.samples_per_sec, argv[1]);
+
+	free(buf);
+	close(in);
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * rtl_wave_verify, checks a capture against its CRC32C sidecar
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "checksum.h"
+#include "metrics.h"
+
+#define BATCH	256	/* records handed to a thread at a time */
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rtl_wave_verify, checks a capture against its CRC32C sidecar\n\n"
+		"Usage:\trtl_wave_verify [options] capture.wav\n"
+		"\t[-s sidecar (default: capture.wav.crc)]\n"
+		"\t[-j threads (default: one per cpu)]\n\n"
+		"Exits with 1 if any block does not match.\n\n");
+	exit(1);
+}
+
+struct job {
+	int data;
+	int sidecar;
+	checksum_header_t header;
+	int64_t count;
+	int64_t next;		/* next record to hand out */
+	uint64_t bytes;
+	uint64_t bad;
+	uint64_t missing;	/* blocks past the end of the capture */
+	pthread_mutex_t lock;	/* for the reports */
+};
+
+static void report(struct job *job, const checksum_record_t *r, const char *what)
+{
+	pthread_mutex_lock(&job->lock);
+	printf("%s: offset %llu, %u bytes, sample %llu\n", what,
+		(unsigned long long)r->offset, r->len,
+		(unsigned long long)(r->offset - job->header.data_offset) / 2);
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void *worker(void *arg)
+{
+	struct job *job = arg;
+	checksum_record_t records[BATCH];
+	uint8_t *buf = NULL;
+	size_t buf_len = 0;
+	int64_t first, n, i;
+	ssize_t got;
+
+	while ((first = __atomic_fetch_add(&job->next, BATCH, __ATOMIC_RELAXED)) < job->count) {
+		n = job->count - first < BATCH ? job->count - first : BATCH;
+		for (i = 0; i < n; i++) {
+			if (pread(job->sidecar, &records[i], sizeof(records[i]),
+			    sizeof(job->header) + (first + i) * job->header.record_size) != sizeof(records[i])) {
+				n = i;
+				break;
+			}
+		}
+		for (i = 0; i < n; i++) {
+			checksum_record_t *r = &records[i];
+			if (r->len > buf_len) {
+				buf_len = r->len;
+				buf = realloc(buf, buf_len);
+			}
+			got = pread(job->data, buf, r->len, r->offset);
+			if (got != (ssize_t)r->len) {
+				__atomic_add_fetch(&job->missing, 1, __ATOMIC_RELAXED);
+				report(job, r, "MISSING");
+				continue;
+			}
+			__atomic_add_fetch(&job->bytes, r->len, __ATOMIC_RELAXED);
+			if (crc32c(0, buf, r->len) != r->crc) {
+				__atomic_add_fetch(&job->bad, 1, __ATOMIC_RELAXED);
+				report(job, r, "BAD");
+			}
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	struct job job;
+	pthread_t *threads;
+	char sidecar[1024], *sidecar_path = NULL;
+	uint64_t start_us;
+	int opt, i, nthreads = 0;
+	double seconds;
+
+	memset(&job, 0, sizeof(job));
+	while ((opt = getopt(argc, argv, "s:j:")) != -1) {
+		switch (opt) {
+		case 's':
+			sidecar_path = optarg;
+			break;
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+	if (argc <= optind) {
+		usage();}
+	if (nthreads <= 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);}
+	if (nthreads <= 0) {
+		nthreads = 1;}
+	if (!sidecar_path) {
+		snprintf(sidecar, sizeof(sidecar), "%s%s", argv[optind], CHECKSUM_SUFFIX);
+		sidecar_path = sidecar;
+	}
+
+	job.data = open(argv[optind], O_RDONLY);
+	if (job.data < 0) {
+		fprintf(stderr, "Failed to open %s\n", argv[optind]);
+		exit(1);
+	}
+	job.sidecar = open(sidecar_path, O_RDONLY);
+	if (job.sidecar < 0 || (job.count = checksum_read_header(job.sidecar, &job.header)) < 0) {
+		fprintf(stderr, "Failed to read checksums %s\n", sidecar_path);
+		exit(1);
+	}
+	posix_fadvise(job.data, 0, 0, POSIX_FADV_SEQUENTIAL);
+	pthread_mutex_init(&job.lock, NULL);
+
+	fprintf(stderr, "Verifying %lld blocks with CRC32C (%s) on %d threads...\n",
+		(long long)job.count, crc32c_impl(), nthreads);
+	start_us = metrics_now();
+	threads = calloc(nthreads, sizeof(pthread_t));
+	for (i = 0; i < nthreads; i++) {
+		pthread_create(&threads[i], NULL, worker, &job);}
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);}
+	seconds = (metrics_now() - start_us) / 1e6;
+
+	fprintf(stderr, "%llu bytes checked, %llu bad blocks, %llu missing, %.0f MB/s.\n",
+		(unsigned long long)job.bytes, (unsigned long long)job.bad,
+		(unsigned long long)job.missing, job.bytes / seconds / 1e6);
+	free(threads);
+	close(job.data);
+	close(job.sidecar);
+	return job.bad || job.missing ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sigmf.h"
+
+const char *sigmf_datatype(int bits)
+{
+	switch (bits) {
+	case 8:
+		return "ci8";
+	case 16:
+		return "ci16_le";
+	default:
+		return "cf32_le";
+	}
+}
+
+int sigmf_open(struct sigmf *m, const char *base, int bits, uint32_t samp_rate,
+	uint32_t frequency, const char *hw)
+{
+	memset(m, 0, sizeof(*m));
+	snprintf(m->path, sizeof(m->path), "%s%s", base, SIGMF_META_SUFFIX);
+	snprintf(m->hw, sizeof(m->hw), "%s", hw ? hw : "");
+	m->datatype = sigmf_datatype(bits);
+	m->samp_rate = samp_rate;
+	/* the time is filled in from the first block */
+	sigmf_capture(m, 0, frequency, 0);
+	return sigmf_write(m);
+}
+
+void sigmf_capture(struct sigmf *m, uint64_t sample, uint32_t frequency, int64_t time_ns)
+{
+	struct sigmf_capture *c = m->ncaptures ? &m->captures[m->ncaptures - 1] : NULL;
+
+	/* a retune and a gap on the same sample make one segment */
+	if (!c || c->sample != sample) {
+		m->captures = realloc(m->captures, (m->ncaptures + 1) * sizeof(*c));
+		c = &m->captures[m->ncaptures++];
+		c->sample = sample;
+		c->frequency = frequency;
+		c->time_ns = 0;
+	}
+	if (frequency) {
+		c->frequency = frequency;}
+	if (time_ns) {
+		c->time_ns = time_ns;}
+	/* a segment without a frequency of its own carries the last one */
+	if (!c->frequency && m->ncaptures > 1) {
+		c->frequency = c[-1].frequency;}
+}
+
+void sigmf_annotate(struct sigmf *m, uint64_t sample, uint64_t count, const char *label)
+{
+	struct sigmf_annotation *a;
+	m->annotations = realloc(m->annotations, (m->nannotations + 1) * sizeof(*a));
+	a = &m->annotations[m->nannotations++];
+	a->sample = sample;
+	a->count = count;
+	snprintf(a->label, sizeof(a->label), "%s", label);
+}
+
+/* JSON string of our own text, only quotes and backslashes need escaping */
+static void sigmf_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			fputc('\\', f);}
+		if ((unsigned char)*s >= ' ') {
+			fputc(*s, f);}
+	}
+	fputc('"', f);
+}
+
+static void sigmf_datetime(FILE *f, int64_t ns)
+{
+	char stamp[32];
+	time_t t = ns / 1000000000;
+	struct tm tm;
+	gmtime_r(&t, &tm);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm);
+	fprintf(f, "\"%s.%06dZ\"", stamp, (int)(ns % 1000000000 / 1000));
+}
+
+int sigmf_write(struct sigmf *m)
+{
+	char tmp[1100];
+	FILE *f;
+	int i;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", m->path);
+	f = fopen(tmp, "w");
+	if (!f) {
+		fprintf(stderr, "WARNING: Failed to write %s\n", tmp);
+		return -1;
+	}
+	fprintf(f, "{\n  \"global\": {\n");
+	fprintf(f, "    \"core:datatype\": \"%s\",\n", m->datatype);
+	fprintf(f, "    \"core:sample_rate\": %u,\n", m->samp_rate);
+	fprintf(f, "    \"core:version\": \"1.0.0\",\n");
+	fprintf(f, "    \"core:num_channels\": 1,\n");
+	if (m->hw[0]) {
+		fprintf(f, "    \"core:hw\": ");
+		sigmf_string(f, m->hw);
+		fprintf(f, ",\n");
+	}
+	fprintf(f, "    \"core:recorder\": \"rtl_wave\"\n  },\n  \"captures\": [");
+	for (i = 0; i < m->ncaptures; i++) {
+		struct sigmf_capture *c = &m->captures[i];
+		fprintf(f, "%s\n    {\"core:sample_start\": %llu, \"core:frequency\": %u",
+			i ? "," : "", (unsigned long long)c->sample, c->frequency);
+		if (c->time_ns) {
+			fprintf(f, ", \"core:datetime\": ");
+			sigmf_datetime(f, c->time_ns);
+		}
+		fprintf(f, "}");
+	}
+	fprintf(f, "\n  ],\n  \"annotations\": [");
+	for (i = 0; i < m->nannotations; i++) {
+		struct sigmf_annotation *a = &m->annotations[i];
+		fprintf(f, "%s\n    {\"core:sample_start\": %llu, ", i ? "," : "",
+			(unsigned long long)a->sample);
+		if (a->count) {
+			fprintf(f, "\"core:sample_count\": %llu, ", (unsigned long long)a->count);}
+		fprintf(f, "\"core:label\": ");
+		sigmf_string(f, a->label);
+		fprintf(f, "}");
+	}
+	fprintf(f, "\n  ]\n}\n");
+	if (fclose(f) != 0 || rename(tmp, m->path) < 0) {
+		fprintf(stderr, "WARNING: Failed to write %s\n", m->path);
+		return -1;
+	}
+	return 0;
+}
+
+void sigmf_close(struct sigmf *m)
+{
+	sigmf_write(m);
+	free(m->captures);
+	free(m->annotations);
+	m->captures = NULL;
+	m->annotations = NULL;
+}
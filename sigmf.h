@@ -0,0 +1,121 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SIGMF_H
+#define __SIGMF_H
+
+#include <stdint.h>
+
+#include "wave.h"
+
+/* SigMF metadata for a capture written as a bare .sigmf-data file
+ *
+ * The .sigmf-meta file is rewritten whole, through a temporary file
+ * and a rename, each time a capture segment or annotation is added,
+ * so a reader never sees it half written.
+ */
+
+#define SIGMF_DATA_SUFFIX	".sigmf-data"
+#define SIGMF_META_SUFFIX	".sigmf-meta"
+
+struct sigmf_capture {
+	uint64_t sample;	/* first sample in the data file */
+	uint32_t frequency;
+	int64_t time_ns;	/* UTC, 0 when the samples run on from the last */
+};
+
+struct sigmf_annotation {
+	uint64_t sample;
+	uint64_t count;
+	char label[WAVE_LABEL];
+};
+
+struct sigmf {
+	char path[1024];	/* of the .sigmf-meta */
+	const char *datatype;
+	uint32_t samp_rate;
+	char hw[256];
+	struct sigmf_capture *captures;
+	int ncaptures;
+	struct sigmf_annotation *annotations;
+	int nannotations;
+};
+
+/*!
+ * SigMF name of a sample format
+ *
+ * \param bits 8 or 16 for signed integers, 32 for float
+ * \return "ci8", "ci16_le" or "cf32_le"
+ */
+
+const char *sigmf_datatype(int bits);
+
+/*!
+ * Start the metadata of a capture
+ *
+ * \param m the metadata
+ * \param base path without the SigMF suffixes
+ * \param bits of each I or Q component, as for sigmf_datatype()
+ * \param samp_rate in samples/second
+ * \param frequency center frequency of the first capture segment
+ * \param hw description of the receiver, or NULL
+ * \return 0 on success
+ */
+
+int sigmf_open(struct sigmf *m, const char *base, int bits, uint32_t samp_rate,
+	uint32_t frequency, const char *hw);
+
+/*!
+ * Start a capture segment, after a retune or lost samples
+ *
+ * \param m the metadata
+ * \param sample first sample of the segment in the data file
+ * \param frequency center frequency in Hz
+ * \param time_ns UTC time of the sample, 0 if it follows on in time
+ */
+
+void sigmf_capture(struct sigmf *m, uint64_t sample, uint32_t frequency, int64_t time_ns);
+
+/*!
+ * Annotate a span of samples
+ *
+ * \param m the metadata
+ * \param sample first sample in the data file
+ * \param count number of samples, 0 for a point
+ * \param label text of the annotation
+ */
+
+void sigmf_annotate(struct sigmf *m, uint64_t sample, uint64_t count, const char *label);
+
+/*!
+ * Rewrite the .sigmf-meta file
+ *
+ * \param m the metadata
+ * \return 0 on success
+ */
+
+int sigmf_write(struct sigmf *m);
+
+/*!
+ * Write the final metadata and free it
+ *
+ * \param m the metadata
+ */
+
+void sigmf_close(struct sigmf *m);
+
+#endif
@@ -0,0 +1,540 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "rtl-sdr.h"
+#include "convenience.h"
+#include "metrics.h"
+#include "wave.h"
+#include "sink.h"
+
+#define SINK_WAIT_MS		50	/* between tries while an output is full */
+#define SINK_STOP_MS		2000	/* most time left to drain a full output at exit */
+#define SINK_SHM_SECONDS	10
+#define SINK_SPILL_CHUNK	(1 << 20)
+
+static const char *policy_names[] = {"block", "newest", "oldest", "spill"};
+
+static void sink_count(uint64_t *counter, uint64_t n)
+{
+	__atomic_add_fetch(counter, n, __ATOMIC_RELAXED);
+}
+
+/* the WAVE header for a stream starting now */
+static void sink_header(struct sink *s, uint8_t *buf)
+{
+	FILE *file = fmemopen(buf, WAVE_HEADER_SIZE + 1, "w");
+	if (s->demod) {
+		wave_header_audio(file, s->demod->audio_rate, s->frequency + (int32_t)s->demod->offset);
+	} else if (s->resample) {
+		wave_header(file, s->resample->out_rate, s->frequency, 16);
+	} else {
+		wave_header(file, s->samp_rate, s->frequency, 8);}
+	fclose(file);
+}
+
+static void sink_nonblock(int fd)
+{
+	struct stat st;
+	/* regular files are never full, and a shared tty must stay blocking */
+	if (fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode))) {
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);}
+}
+
+static int sink_listen(struct sink *s, char *where)
+{
+	struct addrinfo hints, *res;
+	char *port = strrchr(where, ':');
+	char *host = NULL;
+	int one = 1, r;
+
+	if (port) {
+		*port++ = '\0';
+		host = where;
+	} else {
+		port = where;}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+	r = getaddrinfo(host, port, &hints, &res);
+	if (r != 0) {
+		fprintf(stderr, "Sink %s: %s\n", s->name, gai_strerror(r));
+		return -1;
+	}
+	s->listener = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (s->listener >= 0) {
+		setsockopt(s->listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));}
+	if (s->listener < 0 ||
+	    bind(s->listener, res->ai_addr, res->ai_addrlen) < 0 ||
+	    listen(s->listener, 1) < 0) {
+		fprintf(stderr, "Sink %s: failed to listen: %s\n", s->name, strerror(errno));
+		freeaddrinfo(res);
+		return -1;
+	}
+	freeaddrinfo(res);
+	fcntl(s->listener, F_SETFL, fcntl(s->listener, F_GETFL) | O_NONBLOCK);
+	s->type = SINK_TCP;
+	return 0;
+}
+
+static int sink_shm(struct sink *s, char *where)
+{
+	char name[256];
+	char *seconds = strchr(where, ':');
+	double secs = SINK_SHM_SECONDS;
+	FILE *file;
+	int fd;
+
+	if (seconds) {
+		*seconds++ = '\0';
+		secs = atof(seconds);
+	}
+	snprintf(name, sizeof(name), "%s%s", where[0] == '/' ? "" : "/", where);
+	s->region = (uint64_t)(secs * s->samp_rate) * 2;
+	s->shm_len = WAVE_RING_HEADER_SIZE + s->region;
+	fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0 || !s->region || ftruncate(fd, s->shm_len) < 0) {
+		fprintf(stderr, "Sink %s: failed to create %s: %s\n", s->name, name, strerror(errno));
+		if (fd >= 0) {
+			close(fd);}
+		return -1;
+	}
+	s->shm = mmap(NULL, s->shm_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (s->shm == MAP_FAILED) {
+		s->shm = NULL;
+		fprintf(stderr, "Sink %s: failed to map %s\n", s->name, name);
+		return -1;
+	}
+	file = fmemopen(s->shm, WAVE_RING_HEADER_SIZE + 1, "w");
+	wave_header_ring(file, s->samp_rate, s->frequency, s->region);
+	fclose(file);
+	s->type = SINK_SHM;
+	return 0;
+}
+
+/* copy into the shared ring, then publish the new count for readers */
+static void sink_shm_put(struct sink *s, const uint8_t *buf, size_t len)
+{
+	uint64_t *written = (uint64_t *)(s->shm + WAVE_RING_WRITTEN_OFFSET);
+	while (len) {
+		uint64_t at = s->data_bytes % s->region;
+		size_t piece = len < s->region - at ? len : s->region - at;
+		memcpy(s->shm + WAVE_RING_HEADER_SIZE + at, buf, piece);
+		buf += piece;
+		len -= piece;
+		s->data_bytes += piece;
+	}
+	__atomic_store_n(written, s->data_bytes, __ATOMIC_RELEASE);
+}
+
+int sink_open(struct sink *s, const char *spec, struct pool *pool,
+	uint32_t samp_rate, uint32_t frequency)
+{
+	uint8_t header[WAVE_HEADER_SIZE + 1];
+	char buf[256], spill[256];
+	char *dest, *policy, *depth;
+	const char *dir = getenv("TMPDIR");
+	const char *rest;
+	int i;
+
+	memset(s, 0, sizeof(*s));
+	s->fd = s->listener = s->spill_fd = -1;
+	s->pool = pool;
+	s->cpu = -1;
+	s->samp_rate = samp_rate;
+	s->frequency = frequency;
+	snprintf(buf, sizeof(buf), "%s", spec);
+	dest = strtok(buf, ",");
+	policy = strtok(NULL, ",");
+	depth = strtok(NULL, ",");
+	if (!dest) {
+		fprintf(stderr, "Empty sink.\n");
+		return -1;
+	}
+	snprintf(s->name, sizeof(s->name), "%s", dest);
+
+	if ((rest = demod_dest(dest)) != NULL) {
+		s->demod = malloc(sizeof(*s->demod));
+		if (!s->demod || demod_open(s->demod, dest, samp_rate) < 0) {
+			free(s->demod);
+			s->demod = NULL;
+			return -1;
+		}
+	} else if ((rest = resample_dest(dest)) != NULL) {
+		s->resample = malloc(sizeof(*s->resample));
+		if (!s->resample || resample_open(s->resample, dest, samp_rate) < 0) {
+			free(s->resample);
+			s->resample = NULL;
+			return -1;
+		}
+	}
+	if (rest) {
+		dest = (char *)rest;
+		if (strncmp(dest, "shm:", 4) == 0) {
+			fprintf(stderr, "Sink %s: shared memory takes 8 bit I/Q only.\n", s->name);
+			return -1;
+		}
+	}
+
+	if (strncmp(dest, "tcp:", 4) == 0) {
+		if (sink_listen(s, dest + 4) < 0) {
+			return -1;}
+		/* network clients are the usual slow ones */
+		s->policy = SINK_DROP_OLDEST;
+	} else if (strncmp(dest, "shm:", 4) == 0) {
+		if (sink_shm(s, dest + 4) < 0) {
+			return -1;}
+	} else {
+		s->fd = strcmp(dest, "-") == 0 ? STDOUT_FILENO :
+			open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (s->fd < 0) {
+			fprintf(stderr, "Sink %s: failed to open: %s\n", s->name, strerror(errno));
+			return -1;
+		}
+		sink_nonblock(s->fd);
+	}
+
+	if (policy) {
+		for (i = 0; i < 4 && strcmp(policy, policy_names[i]); i++);
+		if (i == 4) {
+			fprintf(stderr, "Sink %s: policy %s is not block, newest, oldest or spill.\n",
+				s->name, policy);
+			return -1;
+		}
+		s->policy = i;
+	}
+	s->depth = depth ? atoi(depth) : pool->count / 4;
+	/* even a blocking sink must leave the capture and the others
+	 * blocks to work with, past half the pool it drops the new one */
+	if (s->policy == SINK_BLOCK && (!depth || s->depth > pool->count / 2)) {
+		s->depth = pool->count / 2;}
+	if (s->depth < 1) {
+		s->depth = 1;}
+
+	if (s->policy == SINK_SPILL) {
+		snprintf(spill, sizeof(spill), "%s/rtl_wave_spill.XXXXXX", dir ? dir : "/tmp");
+		s->spill_fd = mkstemp(spill);
+		if (s->spill_fd < 0) {
+			fprintf(stderr, "Sink %s: failed to create a spill file: %s\n",
+				s->name, strerror(errno));
+			return -1;
+		}
+		unlink(spill);
+	}
+
+	if (s->type == SINK_FILE) {
+		sink_header(s, header);
+		if (write(s->fd, header, WAVE_HEADER_SIZE) != WAVE_HEADER_SIZE) {
+			fprintf(stderr, "Sink %s: failed to write the header.\n", s->name);
+			return -1;
+		}
+	}
+	/* room for every block in the pool, so a push never waits */
+	if (queue_init(&s->queue, pool->count) < 0) {
+		return -1;}
+	fprintf(stderr, "Sink %s: %s, %d blocks deep.\n", s->name,
+		policy_names[s->policy], s->depth);
+	if (s->demod) {
+		fprintf(stderr, "Sink %s: %s at %+.0f Hz, %u Hz IF, %u Hz audio.\n", s->name,
+			demod_name(s->demod->mode), s->demod->offset, s->demod->if_rate,
+			s->demod->audio_rate);}
+	if (s->resample) {
+		fprintf(stderr, "Sink %s: resampled by %u/%u to %u Hz, %d taps per phase.\n",
+			s->name, s->resample->up, s->resample->down, s->resample->out_rate,
+			s->resample->ntaps);}
+	return 0;
+}
+
+static void sink_spill_queued(struct sink *s);
+
+/* write all of buf to the file, pipe or client, waiting while it is
+ * full; -1 if it failed or is still full past the stop deadline */
+static int sink_send(struct sink *s, const uint8_t *buf, size_t len)
+{
+	struct pollfd pfd;
+	ssize_t r;
+
+	while (len) {
+		if (s->type == SINK_TCP) {
+			r = send(s->fd, buf, len, MSG_NOSIGNAL);
+		} else {
+			r = write(s->fd, buf, len);}
+		if (r > 0) {
+			buf += r;
+			len -= r;
+			continue;
+		}
+		if (r < 0 && errno == EINTR) {
+			continue;}
+		if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (s->stop_deadline && metrics_now() > s->stop_deadline) {
+				return -1;}
+			/* keep the queue moving while the output is full */
+			if (s->policy == SINK_SPILL) {
+				sink_spill_queued(s);}
+			pfd.fd = s->fd;
+			pfd.events = POLLOUT;
+			poll(&pfd, 1, SINK_WAIT_MS);
+			continue;
+		}
+		return -1;
+	}
+	return 0;
+}
+
+static void sink_drop_client(struct sink *s)
+{
+	fprintf(stderr, "Sink %s: client gone.\n", s->name);
+	close(s->fd);
+	s->fd = -1;
+	/* whatever was spilled was for the old client */
+	s->spill_head = s->spill_tail = 0;
+}
+
+/* take a waiting tcp client, starting its stream with a header */
+static void sink_accept(struct sink *s)
+{
+	uint8_t header[WAVE_HEADER_SIZE + 1];
+	int fd = accept(s->listener, NULL, NULL);
+	if (fd < 0) {
+		return;}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	s->fd = fd;
+	sink_count(&s->clients, 1);
+	fprintf(stderr, "Sink %s: client connected.\n", s->name);
+	sink_header(s, header);
+	if (sink_send(s, header, WAVE_HEADER_SIZE) < 0) {
+		sink_drop_client(s);}
+}
+
+/* hand samples to the output; 0 when they were taken, 1 when there
+ * is nobody to take them, -1 when they were lost */
+static int sink_out(struct sink *s, const uint8_t *buf, size_t len)
+{
+	int16_t *converted;
+
+	/* blocks are queued and spilled as they came, and demodulated or
+	 * resampled on the way out so every sample goes through in order */
+	if (s->demod) {
+		len = (size_t)demod_block(s->demod, buf, len, &converted) * sizeof(int16_t);
+		buf = (const uint8_t *)converted;
+	} else if (s->resample) {
+		len = (size_t)resample_block(s->resample, buf, len, &converted) * 2 * sizeof(int16_t);
+		buf = (const uint8_t *)converted;
+	}
+	switch (s->type) {
+	case SINK_SHM:
+		sink_shm_put(s, buf, len);
+		return 0;
+	case SINK_TCP:
+		if (s->fd < 0 && !s->stop_deadline) {
+			sink_accept(s);}
+		if (s->fd < 0) {
+			return 1;}
+		if (sink_send(s, buf, len) < 0) {
+			sink_drop_client(s);
+			return -1;
+		}
+		return 0;
+	default:
+		if (s->failed) {
+			return -1;}
+		if (sink_send(s, buf, len) < 0) {
+			fprintf(stderr, "WARNING: Sink %s failed, no more samples go to it.\n", s->name);
+			s->failed = 1;
+			return -1;
+		}
+		s->data_bytes += len;
+		return 0;
+	}
+}
+
+static void sink_spill(struct sink *s, const uint8_t *buf, size_t len)
+{
+	if (pwrite(s->spill_fd, buf, len, s->spill_head) != (ssize_t)len) {
+		sink_count(&s->dropped, len / 2);
+		return;
+	}
+	s->spill_head += len;
+	sink_count(&s->spilled, len);
+}
+
+/* move every queued block to the spill file, they go out from there */
+static void sink_spill_queued(struct sink *s)
+{
+	struct block *b;
+	while ((b = queue_try_pop(&s->queue)) != NULL) {
+		sink_spill(s, b->data, b->len);
+		pool_put(s->pool, b);
+	}
+}
+
+/* send the oldest spilled chunk, and start over once all is sent */
+static void sink_unspill(struct sink *s, uint8_t *buf)
+{
+	uint64_t left = s->spill_head - s->spill_tail;
+	size_t n = left < SINK_SPILL_CHUNK ? left : SINK_SPILL_CHUNK;
+
+	if (pread(s->spill_fd, buf, n, s->spill_tail) != (ssize_t)n ||
+	    sink_out(s, buf, n) != 0) {
+		sink_count(&s->dropped, (s->spill_head - s->spill_tail) / 2);
+		s->spill_head = s->spill_tail;
+	} else {
+		s->spill_tail += n;
+		sink_count(&s->bytes, n);
+	}
+	if (s->spill_tail == s->spill_head) {
+		s->spill_head = s->spill_tail = 0;
+		if (ftruncate(s->spill_fd, 0) < 0) {
+			fprintf(stderr, "WARNING: Sink %s failed to trim its spill file.\n", s->name);}
+	}
+}
+
+static void *sink_thread(void *arg)
+{
+	struct sink *s = arg;
+	uint8_t *buf = s->spill_fd >= 0 ? malloc(SINK_SPILL_CHUNK) : NULL;
+	struct block *b;
+	sigset_t pipe;
+
+	/* a reader that goes away fails this sink with EPIPE instead of
+	 * raising SIGPIPE, which stops the capture */
+	sigemptyset(&pipe);
+	sigaddset(&pipe, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe, NULL);
+	verbose_cpu_affinity("sink", s->cpu);
+	while (1) {
+		/* once spilling, everything goes through the spill file
+		 * until it has been sent, so the order is kept */
+		if (s->spill_head > s->spill_tail) {
+			sink_spill_queued(s);
+			sink_unspill(s, buf);
+			continue;
+		}
+		b = queue_pop(&s->queue);
+		if (!b) {
+			break;}
+		switch (sink_out(s, b->data, b->len)) {
+		case 0:
+			sink_count(&s->blocks, 1);
+			sink_count(&s->bytes, b->len);
+			break;
+		case -1:
+			sink_count(&s->dropped, b->len / 2);
+			break;
+		}
+		pool_put(s->pool, b);
+	}
+	free(buf);
+	return NULL;
+}
+
+int sink_start(struct sink *s, int cpu)
+{
+	s->cpu = cpu;
+	if (pthread_create(&s->thread, NULL, sink_thread, s) != 0) {
+		fprintf(stderr, "Sink %s: failed to start its thread.\n", s->name);
+		return -1;
+	}
+	s->running = 1;
+	return 0;
+}
+
+void sink_submit(struct sink *s, struct block *b)
+{
+	struct block *old;
+
+	if (queue_depth(&s->queue) >= s->depth) {
+		old = s->policy == SINK_DROP_OLDEST ? queue_try_pop(&s->queue) : NULL;
+		if (!old) {
+			/* newest, a block sink holding its share of the pool,
+			 * or a spill that cannot keep up either */
+			sink_count(&s->dropped, b->len / 2);
+			return;
+		}
+		sink_count(&s->dropped, old->len / 2);
+		pool_put(s->pool, old);
+	}
+	pool_ref(b);
+	if (queue_push(&s->queue, b) < 0) {
+		pool_put(s->pool, b);}
+}
+
+void sink_report(struct sink *s, char *buf, size_t len)
+{
+	snprintf(buf, len, "%s %s blocks %llu bytes %llu dropped %llu spilled %llu",
+		s->name, policy_names[s->policy],
+		(unsigned long long)__atomic_load_n(&s->blocks, __ATOMIC_RELAXED),
+		(unsigned long long)__atomic_load_n(&s->bytes, __ATOMIC_RELAXED),
+		(unsigned long long)__atomic_load_n(&s->dropped, __ATOMIC_RELAXED),
+		(unsigned long long)__atomic_load_n(&s->spilled, __ATOMIC_RELAXED));
+	if (s->type == SINK_TCP) {
+		snprintf(buf + strlen(buf), len - strlen(buf), " clients %llu",
+			(unsigned long long)__atomic_load_n(&s->clients, __ATOMIC_RELAXED));}
+}
+
+void sink_stop(struct sink *s)
+{
+	char report[512];
+	struct stat st;
+
+	s->stop_deadline = metrics_now() + SINK_STOP_MS * 1000;
+	if (s->running) {
+		queue_close(&s->queue);
+		pthread_join(s->thread, NULL);
+		s->running = 0;
+	}
+	queue_free(&s->queue);
+	sink_report(s, report, sizeof(report));
+	fprintf(stderr, "Sink %s\n", report);
+
+	if (s->type == SINK_FILE && fstat(s->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+	    wave_update_sizes(s->fd, s->data_bytes) < 0) {
+		fprintf(stderr, "WARNING: Sink %s failed to update its header sizes.\n", s->name);}
+	if (s->fd >= 0 && s->fd != STDOUT_FILENO) {
+		close(s->fd);}
+	if (s->listener >= 0) {
+		close(s->listener);}
+	if (s->spill_fd >= 0) {
+		close(s->spill_fd);}
+	if (s->shm) {
+		munmap(s->shm, s->shm_len);}
+	if (s->demod) {
+		demod_free(s->demod);
+		free(s->demod);
+		s->demod = NULL;
+	}
+	if (s->resample) {
+		resample_free(s->resample);
+		free(s->resample);
+		s->resample = NULL;
+	}
+}
@@ -0,0 +1,142 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SINK_H
+#define __SINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "demod.h"
+#include "resample.h"
+
+/* extra outputs fed the same converted blocks as the recording, each
+ * from its own thread and queue so one falling behind only costs
+ * itself samples */
+
+#define SINK_MAX	8
+
+enum sink_type {SINK_FILE, SINK_TCP, SINK_SHM};
+
+/* what a sink does with a block when depth blocks are already queued */
+enum sink_policy {
+	SINK_BLOCK,		/* queue on, up to half the pool, then drop
+				 * the new block */
+	SINK_DROP_NEWEST,	/* drop the new block */
+	SINK_DROP_OLDEST,	/* drop the oldest queued block */
+	SINK_SPILL,		/* queue it, the thread spills the queue to a
+				 * temporary file while the output is full */
+};
+
+struct sink {
+	char name[256];		/* the destination as given */
+	enum sink_type type;
+	enum sink_policy policy;
+	int depth;
+	struct pool *pool;
+	struct queue queue;
+	pthread_t thread;
+	int cpu;
+	int running;
+	volatile uint64_t stop_deadline; /* set by sink_stop(), from metrics_now() */
+	int fd;			/* output file or tcp client, -1 for none */
+	int listener;		/* tcp */
+	int failed;		/* a file or pipe that cannot be written */
+	uint32_t samp_rate;
+	uint32_t frequency;
+	struct demod *demod;	/* audio instead of I/Q, NULL for I/Q */
+	struct resample *resample; /* 16 bit I/Q at another rate, or NULL */
+	uint64_t data_bytes;	/* after the header, also ring.written for shm */
+	uint8_t *shm;		/* mapping laid out as a circular capture */
+	size_t shm_len;
+	uint64_t region;
+	int spill_fd;
+	uint64_t spill_head;	/* bytes spilled */
+	uint64_t spill_tail;	/* bytes sent back out of the spill file */
+	/* counters, read by other threads */
+	uint64_t blocks;
+	uint64_t bytes;
+	uint64_t dropped;	/* samples */
+	uint64_t spilled;	/* bytes */
+	uint64_t clients;
+};
+
+/*!
+ * Open a sink and write its WAVE header
+ *
+ * The spec is a destination, then optionally a policy and a depth:
+ * path, "-" for stdout, "tcp:[host:]port" to serve one client at
+ * a time, or "shm:name[:seconds]" for a shared memory circular
+ * capture; the policy is block, newest, oldest or spill, e.g.
+ * "tcp:1234,oldest,8".  A file, stdout or tcp destination can start
+ * with a demodulator, e.g. "nbfm@12.5k:tcp:1234", for 16 bit mono
+ * audio instead of the I/Q samples, or with a resampler, e.g.
+ * "resample@192k:hdsdr.wav", for 16 bit I/Q at that rate.
+ *
+ * \param s the sink
+ * \param spec destination[,policy[,depth]]
+ * \param pool where the blocks come from
+ * \param samp_rate in samples/second, for the headers
+ * \param frequency center frequency in Hz, for the headers
+ * \return 0 on success
+ */
+
+int sink_open(struct sink *s, const char *spec, struct pool *pool,
+	uint32_t samp_rate, uint32_t frequency);
+
+/*!
+ * Start the sink thread
+ *
+ * \param s the sink
+ * \param cpu to pin the thread to, negative for none
+ * \return 0 on success
+ */
+
+int sink_start(struct sink *s, int cpu);
+
+/*!
+ * Queue a shared reference to a converted block, never waits
+ *
+ * \param s the sink
+ * \param b block, still owned by the caller
+ */
+
+void sink_submit(struct sink *s, struct block *b);
+
+/*!
+ * Describe the sink and its counters in one line
+ *
+ * \param s the sink
+ * \param buf for the text
+ * \param len size of buf
+ */
+
+void sink_report(struct sink *s, char *buf, size_t len);
+
+/*!
+ * Drain the queue, stop the thread and close the output
+ *
+ * An output still full a couple of seconds later is given up on.
+ *
+ * \param s the sink
+ */
+
+void sink_stop(struct sink *s);
+
+#endif
@@ -0,0 +1,365 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include "metrics.h"
+#include "synth.h"
+
+#define L	SYNTH_LANES
+
+/* a lane anywhere in a chunk, whatever its alignment */
+typedef float synth_lane_u __attribute__((vector_size(L * sizeof(float)), aligned(4)));
+#define NOISE_VAR	21845.0	/* of the sum of four uniform bytes */
+
+/* a number with an optional k, M or G suffix */
+static double synth_number(const char *s)
+{
+	char *end;
+	double v = strtod(s, &end);
+	switch (*end) {
+	case 'k': case 'K':
+		return v * 1e3;
+	case 'M':
+		return v * 1e6;
+	case 'G':
+		return v * 1e9;
+	}
+	return v;
+}
+
+static float synth_db(double db)
+{
+	return (float)pow(10, db / 20);
+}
+
+static struct synth_signal *synth_add(struct synth *s, double freq, float amp)
+{
+	struct synth_signal *g;
+	if (s->nsignals == SYNTH_SIGNALS) {
+		fprintf(stderr, "At most %d synthetic signals.\n", SYNTH_SIGNALS);
+		return NULL;
+	}
+	g = &s->signals[s->nsignals++];
+	memset(g, 0, sizeof(*g));
+	g->freq = freq;
+	g->amp = amp;
+	return g;
+}
+
+int synth_open(struct synth *s, const char *spec, uint32_t samp_rate, uint32_t frequency)
+{
+	char copy[1024], *item, *save, *arg[5];
+	double noise = 0, snr = 0, power = 0;
+	int have_snr = 0, ok, n, k;
+	uint32_t seed = 1;
+	struct synth_signal *g;
+
+	memset(s, 0, sizeof(*s));
+	s->samp_rate = samp_rate;
+	s->frequency = frequency;
+	s->iq_gain = 1;
+	if (strncmp(spec, SYNTH_PREFIX, strlen(SYNTH_PREFIX)) == 0) {
+		spec += strlen(SYNTH_PREFIX);}
+	snprintf(copy, sizeof(copy), "%s", spec);
+
+	for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+		for (n = 0; n < 5 && (arg[n] = strsep(&item, ":")) != NULL; n++);
+		ok = 1;
+		if (strcmp(arg[0], "tone") == 0 && n >= 2) {
+			ok = synth_add(s, synth_number(arg[1]), synth_db(n > 2 ? atof(arg[2]) : -10)) != NULL;
+		} else if (strcmp(arg[0], "comb") == 0 && n >= 3) {
+			double spacing = synth_number(arg[1]);
+			int count = atoi(arg[2]);
+			ok = count > 0;
+			for (k = 0; k < count && ok; k++) {
+				ok = synth_add(s, (k - (count - 1) / 2.0) * spacing,
+					synth_db(n > 3 ? atof(arg[3]) : -10)) != NULL;}
+		} else if (strcmp(arg[0], "chirp") == 0 && n >= 4) {
+			double from = synth_number(arg[1]), seconds = atof(arg[3]);
+			g = seconds * samp_rate >= 1 ?
+				synth_add(s, from, synth_db(n > 4 ? atof(arg[4]) : -10)) : NULL;
+			if (g) {
+				g->period = (uint64_t)(seconds * samp_rate);
+				g->rate = (synth_number(arg[2]) - from) / seconds;
+			}
+			ok = g != NULL;
+		} else if (strcmp(arg[0], "noise") == 0 && n == 2) {
+			noise = pow(10, atof(arg[1]) / 10);
+			have_snr = 0;
+		} else if (strcmp(arg[0], "snr") == 0 && n == 2) {
+			snr = atof(arg[1]);
+			have_snr = 1;
+		} else if (strcmp(arg[0], "burst") == 0 && n == 3) {
+			s->burst_on = (uint64_t)(atof(arg[1]) * samp_rate);
+			s->burst_period = (uint64_t)(atof(arg[2]) * samp_rate);
+			ok = s->burst_period > 0;
+		} else if (strcmp(arg[0], "dc") == 0 && n == 3) {
+			s->dc_i = atof(arg[1]);
+			s->dc_q = atof(arg[2]);
+		} else if (strcmp(arg[0], "iq") == 0 && n == 3) {
+			s->iq_gain = synth_db(atof(arg[1]));
+			s->iq_phase = atof(arg[2]) * M_PI / 180;
+		} else if (strcmp(arg[0], "pace") == 0 && n == 2) {
+			s->pace = atof(arg[1]);
+		} else if (strcmp(arg[0], "seed") == 0 && n == 2) {
+			seed = (uint32_t)atoi(arg[1]);
+		} else {
+			ok = 0;
+		}
+		if (!ok) {
+			fprintf(stderr, "Bad synthetic source item: %s\n", arg[0]);
+			return -1;
+		}
+	}
+
+	/* noise to the SNR of all the signals, while they are on */
+	for (k = 0; k < s->nsignals; k++) {
+		power += (double)s->signals[k].amp * s->signals[k].amp;}
+	if (have_snr) {
+		noise = power / pow(10, snr / 10);}
+	s->sigma = (float)sqrt(noise / 2 / NOISE_VAR);
+	for (k = 0; k < L; k++) {
+		/* distinct non zero states for every lane */
+		s->rng_i[k] = (seed + k) * 2654435761u | 1;
+		s->rng_q[k] = (seed + k + L) * 2246822519u | 1;
+	}
+
+	fprintf(stderr, "Synthetic source: %d signals at %.1f dBFS, noise at %.1f dBFS, "
+		"%.0f S/s%s\n", s->nsignals, power > 0 ? 10 * log10(power) : -INFINITY,
+		noise > 0 ? 10 * log10(noise) : -INFINITY, (double)samp_rate,
+		s->pace > 0 ? ", paced" : "");
+	return 0;
+}
+
+void synth_tune(struct synth *s, uint32_t frequency)
+{
+	s->shift += (double)s->frequency - frequency;
+	s->frequency = frequency;
+}
+
+/* amp * exp(2 pi j (c0 + a n + b n^2 / 2)) added to the chunk from at
+ * for n from 0 to len; each lane turns by its own step, which for a
+ * chirp turns by the same amount every time */
+static void synth_lanes(struct synth *s, float amp, double c0, double a, double b,
+	uint32_t at, uint32_t len)
+{
+	synth_lane pr, pi, sr, si, t;
+	float dr = (float)cos(2 * M_PI * b * L * L), di = (float)sin(2 * M_PI * b * L * L);
+	float *out_i = s->i + at, *out_q = s->q + at;
+	double c, step;
+	uint32_t m;
+	int k;
+
+	for (k = 0; k < L; k++) {
+		c = c0 + a * k + b * k * k / 2;
+		step = a * L + b * (2.0 * k * L + L * L) / 2;
+		pr[k] = amp * (float)cos(2 * M_PI * (c - floor(c)));
+		pi[k] = amp * (float)sin(2 * M_PI * (c - floor(c)));
+		sr[k] = (float)cos(2 * M_PI * (step - floor(step)));
+		si[k] = (float)sin(2 * M_PI * (step - floor(step)));
+	}
+	for (m = 0; m + L <= len; m += L) {
+		*(synth_lane_u *)(out_i + m) += pr;
+		*(synth_lane_u *)(out_q + m) += pi;
+		t = pr * sr - pi * si;
+		pi = pr * si + pi * sr;
+		pr = t;
+		/* exact for a tone, whose dr and di are 1 and 0 */
+		t = sr * dr - si * di;
+		si = sr * di + si * dr;
+		sr = t;
+	}
+	/* the samples after the last full lane, when a sweep starts over */
+	for (k = 0; m + k < len; k++) {
+		out_i[m + k] += pr[k];
+		out_q[m + k] += pi[k];
+	}
+}
+
+/* add a signal to the chunk of len samples starting at sample */
+static void synth_signal(struct synth *s, struct synth_signal *g, uint64_t sample, uint32_t len)
+{
+	double fs = s->samp_rate, f = (g->freq + s->shift) / fs, b = g->rate / fs / fs;
+	uint64_t pos;
+	uint32_t done = 0, piece;
+
+	if (!g->period) {
+		synth_lanes(s, g->amp, g->phase, f, 0, 0, len);
+		g->phase += f * len;
+		g->phase -= floor(g->phase);
+		return;
+	}
+	/* a sweep starts over at phase 0 every period */
+	while (done < len) {
+		pos = (sample + done) % g->period;
+		piece = len - done;
+		if (piece > g->period - pos) {
+			piece = g->period - pos;}
+		synth_lanes(s, g->amp, f * pos + b * pos * pos / 2, f + b * pos, b, done, piece);
+		done += piece;
+	}
+}
+
+/* silence the signals between bursts */
+static void synth_gate(struct synth *s, uint64_t sample, uint32_t len)
+{
+	uint64_t pos, run;
+	uint32_t j = 0;
+
+	while (j < len) {
+		pos = (sample + j) % s->burst_period;
+		if (pos < s->burst_on) {
+			run = s->burst_on - pos;
+		} else {
+			run = s->burst_period - pos;
+			if (run > len - j) {
+				run = len - j;}
+			memset(s->i + j, 0, run * sizeof(float));
+			memset(s->q + j, 0, run * sizeof(float));
+		}
+		j += run > len - j ? len - j : run;
+	}
+}
+
+/* gaussian enough: the sum of the four bytes of a xorshift32 per lane */
+static void synth_noise(struct synth *s, uint32_t len)
+{
+	synth_ulane x = s->rng_i, y = s->rng_q;
+	synth_ilane sum;
+	uint32_t m;
+
+	for (m = 0; m < len; m += L) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		y ^= y << 13;
+		y ^= y >> 17;
+		y ^= y << 5;
+		sum = (synth_ilane)((x & 255) + (x >> 8 & 255) + (x >> 16 & 255) + (x >> 24));
+		*(synth_lane_u *)(s->i + m) += s->sigma * (__builtin_convertvector(sum, synth_lane) - 510);
+		sum = (synth_ilane)((y & 255) + (y >> 8 & 255) + (y >> 16 & 255) + (y >> 24));
+		*(synth_lane_u *)(s->q + m) += s->sigma * (__builtin_convertvector(sum, synth_lane) - 510);
+	}
+	s->rng_i = x;
+	s->rng_q = y;
+}
+
+/* offset binary 0 to 255 from a lane of levels already scaled */
+static inline synth_ilane synth_clamp(synth_lane v)
+{
+	synth_ilane q = __builtin_convertvector(v, synth_ilane), over;
+	q &= ~(q >> 31);
+	over = (255 - q) >> 31;
+	return (q & ~over) | (255 & over);
+}
+
+/* impair and quantize the chunk the way the dongle delivers it */
+static void synth_quantize(struct synth *s, uint8_t *out, uint32_t len)
+{
+	float gc = s->iq_gain * cosf(s->iq_phase), gs = s->iq_gain * sinf(s->iq_phase);
+	synth_lane vi, vq;
+	synth_ilane pair;
+	uint16_t bytes[L];
+	uint32_t m;
+	int k;
+
+	for (m = 0; m < len; m += L) {
+		vi = *(synth_lane_u *)(s->i + m);
+		vq = *(synth_lane_u *)(s->q + m);
+		vq = gc * vq + gs * vi + s->dc_q;
+		vi = vi + s->dc_i;
+		/* I in the low byte, Q in the high, as the bytes go out */
+		pair = synth_clamp(vi * 127 + 128.5f) | synth_clamp(vq * 127 + 128.5f) << 8;
+		for (k = 0; k < L; k++) {
+			bytes[k] = (uint16_t)pair[k];}
+		if (m + L <= len) {
+			memcpy(out + 2 * m, bytes, sizeof(bytes));
+		} else {
+			memcpy(out + 2 * m, bytes, 2 * (len - m));}
+	}
+}
+
+void synth_generate(struct synth *s, uint8_t *buf, uint32_t len)
+{
+	uint32_t n, samples = len / 2;
+	int k;
+
+	while (samples) {
+		n = samples < SYNTH_CHUNK ? samples : SYNTH_CHUNK;
+		memset(s->i, 0, sizeof(s->i));
+		memset(s->q, 0, sizeof(s->q));
+		for (k = 0; k < s->nsignals; k++) {
+			synth_signal(s, &s->signals[k], s->sample, n);}
+		if (s->burst_period) {
+			synth_gate(s, s->sample, n);}
+		if (s->sigma > 0) {
+			synth_noise(s, n);}
+		synth_quantize(s, buf, n);
+		s->sample += n;
+		buf += 2 * n;
+		samples -= n;
+	}
+}
+
+/* with pace set, wait until the last sample of the next block is due */
+static void synth_wait(struct synth *s, uint32_t len)
+{
+	uint64_t due;
+	struct timespec ts;
+
+	if (s->pace <= 0) {
+		return;}
+	if (!s->start_us) {
+		s->start_us = metrics_now();}
+	due = s->start_us + (uint64_t)((s->sample + len / 2) * 1e6 / s->samp_rate / s->pace);
+	ts.tv_sec = due / 1000000;
+	ts.tv_nsec = due % 1000000 * 1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0 && !s->cancel);
+}
+
+int synth_read_async(struct synth *s, synth_read_cb cb, void *ctx, uint32_t len)
+{
+	uint8_t *buf = malloc(len);
+
+	if (!buf) {
+		return -1;}
+	while (!s->cancel) {
+		synth_wait(s, len);
+		synth_generate(s, buf, len);
+		cb(buf, len, ctx);
+	}
+	free(buf);
+	return 0;
+}
+
+int synth_read_sync(struct synth *s, void *buf, int len, int *n_read)
+{
+	synth_wait(s, len);
+	synth_generate(s, buf, len);
+	*n_read = len;
+	return 0;
+}
+
+void synth_cancel(struct synth *s)
+{
+	s->cancel = 1;
+}
@@ -0,0 +1,149 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __SYNTH_H
+#define __SYNTH_H
+
+#include <stdint.h>
+
+/* a synthetic source standing in for the dongle, with known contents
+ *
+ * It produces the offset binary I/Q bytes the dongle does, from a
+ * spec of comma separated items:
+ *
+ *   tone:offset[:dBFS]		a tone offset from the center frequency
+ *   comb:spacing:count[:dBFS]	count tones spaced round the center
+ *   chirp:from:to:seconds[:dBFS] a linear sweep, repeated
+ *   noise:dBFS			gaussian noise of this power
+ *   snr:dB			noise this far below the tones and chirps
+ *   burst:on:period		the tones and chirps on for on seconds
+ *				of every period
+ *   dc:i:q			offsets, as fractions of full scale
+ *   iq:gain_dB:phase_deg	Q gain and phase error
+ *   pace:factor		real time times factor, default as fast
+ *				as the samples can be made
+ *   seed:n			of the noise
+ *
+ * Levels are of the complex exponential, 0 dBFS is a tone that just
+ * reaches full scale; a tone defaults to -10 dBFS.  Samples are made
+ * in chunks, SYNTH_LANES samples at a time.
+ */
+
+#define SYNTH_PREFIX	"synth:"
+#define SYNTH_SIGNALS	16
+#define SYNTH_CHUNK	1024	/* samples made at a time */
+#define SYNTH_LANES	4
+
+/* lanes of samples, with GCC vector extensions so any target with
+ * vector units gets them */
+typedef float synth_lane __attribute__((vector_size(SYNTH_LANES * sizeof(float))));
+typedef int32_t synth_ilane __attribute__((vector_size(SYNTH_LANES * sizeof(int32_t))));
+typedef uint32_t synth_ulane __attribute__((vector_size(SYNTH_LANES * sizeof(uint32_t))));
+
+struct synth_signal {
+	double freq;		/* Hz from the center, where a chirp starts */
+	double rate;		/* Hz/s of a chirp, 0 for a tone */
+	uint64_t period;	/* samples of a chirp before it starts over */
+	float amp;		/* 1.0 for full scale */
+	double phase;		/* of a tone at the next sample, in cycles */
+};
+
+struct synth {
+	uint32_t samp_rate;
+	uint32_t frequency;
+	double shift;		/* Hz the signals moved by retunes */
+	struct synth_signal signals[SYNTH_SIGNALS];
+	int nsignals;
+	float sigma;		/* noise rms of I or Q */
+	uint64_t burst_on, burst_period; /* samples, 0 for no bursts */
+	float dc_i, dc_q;
+	float iq_gain, iq_phase; /* Q = gain * (Q cos phase + I sin phase) */
+	double pace;
+	uint64_t start_us;	/* when sample 0 was due, once paced */
+	uint64_t sample;	/* samples made so far */
+	synth_ulane rng_i, rng_q;
+	/* the chunk being made, with room for a partial lane */
+	float i[SYNTH_CHUNK + SYNTH_LANES], q[SYNTH_CHUNK + SYNTH_LANES];
+	volatile int cancel;
+};
+
+typedef void (*synth_read_cb)(unsigned char *buf, uint32_t len, void *ctx);
+
+/*!
+ * Set up a synthetic source from a spec
+ *
+ * \param s the source
+ * \param spec items as above, with or without SYNTH_PREFIX
+ * \param samp_rate any rate, in samples/second
+ * \param frequency center frequency the source starts tuned to
+ * \return 0 on success, -1 for a bad spec
+ */
+
+int synth_open(struct synth *s, const char *spec, uint32_t samp_rate, uint32_t frequency);
+
+/*!
+ * Make the next samples
+ *
+ * \param s the source
+ * \param buf interleaved offset binary I/Q bytes, as from the dongle
+ * \param len number of bytes
+ */
+
+void synth_generate(struct synth *s, uint8_t *buf, uint32_t len);
+
+/*!
+ * Retune, the signals stay where they are in frequency
+ *
+ * \param s the source
+ * \param frequency new center frequency
+ */
+
+void synth_tune(struct synth *s, uint32_t frequency);
+
+/*!
+ * Read blocks into a callback until cancelled, like rtlsdr_read_async()
+ *
+ * \param s the source
+ * \param cb called with each block
+ * \param ctx passed to cb
+ * \param len bytes per block
+ * \return 0 once cancelled
+ */
+
+int synth_read_async(struct synth *s, synth_read_cb cb, void *ctx, uint32_t len);
+
+/*!
+ * Read one block, like rtlsdr_read_sync()
+ *
+ * \param s the source
+ * \param buf for the samples
+ * \param len bytes to read
+ * \param n_read bytes read
+ * \return 0 on success
+ */
+
+int synth_read_sync(struct synth *s, void *buf, int len, int *n_read);
+
+/*!
+ * Stop synth_read_async(), safe from a signal handler
+ *
+ * \param s the source
+ */
+
+void synth_cancel(struct synth *s);
+
+#endif
@@ -0,0 +1,316 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "wave.h"
+
+void set_datetime(datetime_t* dt)
+{
+    time_t rawtime = time(NULL);
+    struct tm *tm = gmtime(&rawtime);
+    dt->year = tm->tm_year + 1900;
+    dt->month = tm->tm_mon + 1;
+    dt->day = tm->tm_mday;
+    dt->hour = tm->tm_hour;
+    dt->minute = tm->tm_min;
+    dt->second = tm->tm_sec;
+}
+
+void set_datetime_ns(datetime_t* dt, int64_t ns)
+{
+    time_t t = ns / 1000000000;
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    memset(dt, 0, sizeof(*dt));
+    dt->year = tm.tm_year + 1900;
+    dt->month = tm.tm_mon + 1;
+    dt->day_of_week = tm.tm_wday;
+    dt->day = tm.tm_mday;
+    dt->hour = tm.tm_hour;
+    dt->minute = tm.tm_min;
+    dt->second = tm.tm_sec;
+    dt->milliseconds = ns / 1000000 % 1000;
+}
+
+int64_t datetime_ns(const datetime_t* dt)
+{
+    struct tm tm;
+
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = dt->year - 1900;
+    tm.tm_mon = dt->month - 1;
+    tm.tm_mday = dt->day;
+    tm.tm_hour = dt->hour;
+    tm.tm_min = dt->minute;
+    tm.tm_sec = dt->second;
+#ifdef _WIN32
+    return (int64_t)_mkgmtime(&tm) * 1000000000 + dt->milliseconds * (int64_t)1000000;
+#else
+    return (int64_t)timegm(&tm) * 1000000000 + dt->milliseconds * (int64_t)1000000;
+#endif
+}
+
+void wave_header(FILE *file, uint32_t samp_rate, uint32_t frequency, uint32_t bits_per_sample)
+{
+    auxi_t auxi;
+
+    memset(&auxi, 0, sizeof(auxi_t));
+    auxi.frequency = frequency;
+    set_datetime(&auxi.start_time);
+    wave_header_auxi(file, samp_rate, bits_per_sample, &auxi);
+}
+
+static void write_header(FILE *file, uint32_t samp_rate, uint16_t channels,
+    uint32_t bits_per_sample, const auxi_t *auxi, const ring_t *ring);
+
+void wave_header_auxi(FILE *file, uint32_t samp_rate, uint32_t bits_per_sample, const auxi_t *auxi)
+{
+    write_header(file, samp_rate, 2, bits_per_sample, auxi, NULL);
+}
+
+void wave_header_channels(FILE *file, uint32_t samp_rate, uint16_t channels,
+    uint32_t bits_per_sample, const auxi_t *auxi)
+{
+    write_header(file, samp_rate, channels, bits_per_sample, auxi, NULL);
+}
+
+void wave_header_audio(FILE *file, uint32_t samp_rate, uint32_t frequency)
+{
+    auxi_t auxi;
+
+    memset(&auxi, 0, sizeof(auxi_t));
+    auxi.frequency = frequency;
+    set_datetime(&auxi.start_time);
+    write_header(file, samp_rate, 1, 16, &auxi, NULL);
+}
+
+void wave_header_ring(FILE *file, uint32_t samp_rate, uint32_t frequency, uint64_t region)
+{
+    auxi_t auxi;
+    ring_t ring;
+
+    memset(&auxi, 0, sizeof(auxi_t));
+    auxi.frequency = frequency;
+    set_datetime(&auxi.start_time);
+    ring.region = region;
+    ring.written = 0;
+    write_header(file, samp_rate, 2, 8, &auxi, &ring);
+}
+
+static void write_header(FILE *file, uint32_t samp_rate, uint16_t channels,
+    uint32_t bits_per_sample, const auxi_t *auxi, const ring_t *ring)
+{
+    riff_t riff;
+    fmt_t fmt;
+    chunk_t chunk;
+
+    // write riff header
+    memset(&riff, 0, sizeof(riff_t));
+    strncpy(riff.id, "RIFF", 4);
+    strncpy(riff.type, "WAVE", 4);
+    riff.size = -1;
+    if (ring && WAVE_RING_HEADER_SIZE - 8 + ring->region < UINT32_MAX)
+        riff.size = WAVE_RING_HEADER_SIZE - 8 + ring->region;
+    if (fwrite(&riff, 1, sizeof(riff_t), file) != sizeof(riff_t)) exit(1);
+
+    // write fmt header
+    memset(&chunk, 0, sizeof(chunk_t));
+    strncpy(chunk.id, "fmt ", 4);
+    chunk.size = sizeof(fmt_t);
+    if (fwrite(&chunk, 1, sizeof(chunk_t), file) != sizeof(chunk_t)) exit(1);
+
+    // write fmt data
+    memset(&fmt, 0, sizeof(fmt_t));
+    fmt.format_tag = bits_per_sample == 32 ? 3 : 1; // IEEE float or PCM
+    fmt.channels = channels;
+    fmt.bits_per_sample = bits_per_sample;
+    fmt.samples_per_sec = samp_rate;
+    fmt.data_rate = fmt.channels * fmt.bits_per_sample / 8 * fmt.samples_per_sec;
+    fmt.block_size = fmt.channels * fmt.bits_per_sample / 8;
+    if (fwrite(&fmt, 1, sizeof(fmt_t), file) != sizeof(fmt_t)) exit(1);
+
+    // write auxi header
+    memset(&chunk, 0, sizeof(chunk_t));
+    strncpy(chunk.id, "auxi", 4);
+    chunk.size = sizeof(auxi_t);
+    if (fwrite(&chunk, 1, sizeof(chunk_t), file) != sizeof(chunk_t)) exit(1);
+
+    // write auxi data
+    if (fwrite(auxi, 1, sizeof(auxi_t), file) != sizeof(auxi_t)) exit(1);
+
+    if (ring) {
+        strncpy(chunk.id, "ring", 4);
+        chunk.size = sizeof(ring_t);
+        if (fwrite(&chunk, 1, sizeof(chunk_t), file) != sizeof(chunk_t)) exit(1);
+        if (fwrite(ring, 1, sizeof(ring_t), file) != sizeof(ring_t)) exit(1);
+    }
+
+    // write data header
+    strncpy(chunk.id, "data", 4);
+    chunk.size = ring && ring->region < UINT32_MAX ? ring->region : -1;
+    if (fwrite(&chunk, 1, sizeof(chunk_t), file) != sizeof(chunk_t)) exit(1);
+}
+
+int wave_update_sizes(int fd, uint64_t data_bytes)
+{
+    uint32_t riff_size = -1, data_size = -1;
+
+    if (data_bytes + WAVE_HEADER_SIZE - 8 < UINT32_MAX) {
+        riff_size = data_bytes + WAVE_HEADER_SIZE - 8;
+        data_size = data_bytes;
+    }
+    if (pwrite(fd, &data_size, sizeof(data_size), WAVE_DATA_SIZE_OFFSET) != sizeof(data_size)) return -1;
+    if (pwrite(fd, &riff_size, sizeof(riff_size), WAVE_RIFF_SIZE_OFFSET) != sizeof(riff_size)) return -1;
+    return 0;
+}
+
+int wave_append_cues(int fd, uint64_t data_bytes, const wave_cue_t *cues, int n)
+{
+    chunk_t chunk;
+    uint64_t offset = WAVE_HEADER_SIZE + data_bytes + (data_bytes & 1);
+    uint32_t adtl_size = 4, riff_size, i, text;
+    uint8_t *buf, *p;
+    size_t len;
+
+    if (wave_update_sizes(fd, data_bytes) < 0) return -1;
+    if (!n) return 0;
+    for (i = 0; i < (uint32_t)n; i++) {
+        text = strlen(cues[i].label) + 1;
+        adtl_size += sizeof(chunk_t) + 4 + text + (text & 1);
+        if (cues[i].length) adtl_size += sizeof(chunk_t) + 20;
+    }
+    len = sizeof(chunk_t) + 4 + 24 * n + sizeof(chunk_t) + adtl_size;
+    if (offset + len - 8 >= UINT32_MAX) return -1;
+
+    p = buf = calloc(1, len);
+    if (!buf) return -1;
+    // cue chunk, positions in sample frames of the data chunk
+    memcpy(chunk.id, "cue ", 4);
+    chunk.size = 4 + 24 * n;
+    memcpy(p, &chunk, sizeof(chunk)); p += sizeof(chunk);
+    memcpy(p, &n, 4); p += 4;
+    for (i = 0; i < (uint32_t)n; i++) {
+        uint32_t point[6] = {i + 1, cues[i].position, 0, 0, 0, cues[i].position};
+        memcpy(&point[2], "data", 4);
+        memcpy(p, point, sizeof(point)); p += sizeof(point);
+    }
+    // LIST adtl with the labels and the regions
+    memcpy(chunk.id, "LIST", 4);
+    chunk.size = adtl_size;
+    memcpy(p, &chunk, sizeof(chunk)); p += sizeof(chunk);
+    memcpy(p, "adtl", 4); p += 4;
+    for (i = 0; i < (uint32_t)n; i++) {
+        uint32_t name = i + 1;
+        text = strlen(cues[i].label) + 1;
+        memcpy(chunk.id, "labl", 4);
+        chunk.size = 4 + text;
+        memcpy(p, &chunk, sizeof(chunk)); p += sizeof(chunk);
+        memcpy(p, &name, 4); p += 4;
+        memcpy(p, cues[i].label, text); p += text + (text & 1);
+        if (cues[i].length) {
+            uint32_t ltxt[5] = {name, cues[i].length, 0, 0, 0};
+            memcpy(&ltxt[2], "rgn ", 4);
+            memcpy(chunk.id, "ltxt", 4);
+            chunk.size = sizeof(ltxt);
+            memcpy(p, &chunk, sizeof(chunk)); p += sizeof(chunk);
+            memcpy(p, ltxt, sizeof(ltxt)); p += sizeof(ltxt);
+        }
+    }
+
+    riff_size = offset + len - 8;
+    if (pwrite(fd, buf, len, offset) != (ssize_t)len ||
+        pwrite(fd, &riff_size, sizeof(riff_size), WAVE_RIFF_SIZE_OFFSET) != sizeof(riff_size)) {
+        free(buf);
+        return -1;
+    }
+    free(buf);
+    return 0;
+}
+
+int wave_read_header(int fd, struct wave_info *info)
+{
+    riff_t riff;
+    chunk_t chunk;
+    struct stat st;
+    uint64_t offset = sizeof(riff_t);
+
+    memset(info, 0, sizeof(*info));
+    if (pread(fd, &riff, sizeof(riff), 0) != sizeof(riff)) return -1;
+    if (memcmp(riff.id, "RIFF", 4) || memcmp(riff.type, "WAVE", 4)) return -1;
+    if (fstat(fd, &st) < 0) return -1;
+
+    // walk the chunks up to data
+    while (pread(fd, &chunk, sizeof(chunk), offset) == sizeof(chunk)) {
+        offset += sizeof(chunk);
+        if (!memcmp(chunk.id, "fmt ", 4)) {
+            if (pread(fd, &info->fmt, sizeof(fmt_t), offset) != sizeof(fmt_t)) return -1;
+        } else if (!memcmp(chunk.id, "auxi", 4)) {
+            if (pread(fd, &info->auxi, sizeof(auxi_t), offset) != sizeof(auxi_t)) return -1;
+            info->has_auxi = 1;
+        } else if (!memcmp(chunk.id, "ring", 4)) {
+            if (pread(fd, &info->ring, sizeof(ring_t), offset) != sizeof(ring_t)) return -1;
+            info->has_ring = 1;
+        } else if (!memcmp(chunk.id, "data", 4)) {
+            info->data_offset = offset;
+            info->data_size = chunk.size;
+            if (chunk.size == UINT32_MAX || offset + chunk.size > (uint64_t)st.st_size)
+                info->data_size = st.st_size - offset;
+            return info->fmt.block_size ? 0 : -1;
+        }
+        offset += chunk.size + (chunk.size & 1);
+    }
+    return -1;
+}
+
+const uint8_t *wave_window(struct wave_window *w, int fd, uint64_t offset, uint64_t len, uint64_t span)
+{
+    uint64_t page = sysconf(_SC_PAGESIZE);
+    uint64_t start = offset / page * page;
+    uint64_t size;
+
+    if (w->base && offset >= w->start && offset + len <= w->end)
+        return (const uint8_t *)w->base + (offset - w->start);
+    wave_window_free(w);
+
+    if (span < len) span = len;
+    size = offset - start + span;
+    // a 32 bit machine can neither map nor seek that far
+    if (size > SIZE_MAX || (uint64_t)(off_t)start != start) return NULL;
+    w->base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, (off_t)start);
+    if (w->base == MAP_FAILED) {
+        w->base = NULL;
+        return NULL;
+    }
+    madvise(w->base, size, MADV_SEQUENTIAL);
+    w->len = size;
+    w->start = start;
+    w->end = start + size;
+    return (const uint8_t *)w->base + (offset - start);
+}
+
+void wave_window_free(struct wave_window *w)
+{
+    if (w->base) munmap(w->base, w->len);
+    memset(w, 0, sizeof(*w));
+}
@@ -0,0 +1,285 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WAVE_H
+#define __WAVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+// datetime
+
+typedef struct {
+    uint16_t year;
+    uint16_t month;
+    uint16_t day_of_week;
+    uint16_t day;
+    uint16_t hour;
+    uint16_t minute;
+    uint16_t second;
+    uint16_t milliseconds;
+} __attribute__((packed)) datetime_t;
+
+// riff
+
+typedef struct {
+    char id[4];
+    uint32_t size;
+    char type[4];
+} __attribute__((packed)) riff_t;
+
+// fmt
+
+typedef struct {
+    uint16_t format_tag;
+    uint16_t channels;
+    uint32_t samples_per_sec;
+    uint32_t data_rate;
+    uint16_t block_size;
+    uint16_t bits_per_sample;
+} __attribute__((packed)) fmt_t;
+
+// auxi
+
+typedef struct {
+    datetime_t start_time;
+    datetime_t stop_time;
+    uint32_t frequency; //receiver center frequency
+    uint32_t sample_frequency; //A/D sample frequency before downsampling
+    uint32_t if_frequency; //IF freq if an external down converter is used
+    uint32_t bandwidth; //displayable BW
+    uint32_t dc_offset; //DC offset of I/Q channels in 1/1000's of a count
+} __attribute__((packed)) auxi_t;
+
+// ring, ahead of the data chunk of a circular capture
+
+typedef struct {
+    uint64_t region; //bytes of the data chunk the samples cycle through
+    uint64_t written; //bytes ever written, the head is written % region
+} __attribute__((packed)) ring_t;
+
+// chunk
+
+typedef struct {
+    char id[4];
+    uint32_t size;
+} __attribute__((packed)) chunk_t;
+
+/* bytes written by wave_header() before the first sample */
+#define WAVE_HEADER_SIZE (sizeof(riff_t) + 3 * sizeof(chunk_t) + \
+	sizeof(fmt_t) + sizeof(auxi_t))
+
+/* where wave_header() puts the RIFF and data chunk sizes */
+#define WAVE_RIFF_SIZE_OFFSET 4
+#define WAVE_DATA_SIZE_OFFSET (WAVE_HEADER_SIZE - sizeof(uint32_t))
+
+/* bytes written by wave_header_ring(), and where it keeps ring.written */
+#define WAVE_RING_HEADER_SIZE (WAVE_HEADER_SIZE + sizeof(chunk_t) + sizeof(ring_t))
+#define WAVE_RING_WRITTEN_OFFSET (WAVE_HEADER_SIZE + sizeof(uint64_t))
+
+// cue points, appended after the data chunk when a capture is closed
+
+#define WAVE_LABEL 64
+
+typedef struct {
+    uint32_t position;	//sample frame in the data chunk
+    uint32_t length;	//frames of the region that follows, 0 for a point
+    char label[WAVE_LABEL];
+} wave_cue_t;
+
+// what a reader needs from a capture
+
+struct wave_info {
+    fmt_t fmt;
+    auxi_t auxi;
+    int has_auxi;
+    ring_t ring;
+    int has_ring;
+    uint64_t data_offset;	//first sample byte
+    uint64_t data_size;	//bytes of samples, to the end of the file when streamed
+};
+
+// a page aligned read only mapping of part of a capture
+
+struct wave_window {
+    void *base;
+    size_t len;
+    uint64_t start, end;	//file offsets the mapping covers
+};
+
+/*!
+ * Fill in a datetime with the current UTC time
+ *
+ * \param dt the datetime to set
+ */
+
+void set_datetime(datetime_t* dt);
+
+/*!
+ * Fill in a datetime with a UTC time
+ *
+ * \param dt the datetime to set
+ * \param ns nanoseconds since 1970
+ */
+
+void set_datetime_ns(datetime_t* dt, int64_t ns);
+
+/*!
+ * Convert a UTC datetime to unix time
+ *
+ * \param dt the datetime, as written by set_datetime()
+ * \return nanoseconds since 1970
+ */
+
+int64_t datetime_ns(const datetime_t* dt);
+
+/*!
+ * Write the RIFF, fmt, auxi and data headers for a streamed capture
+ *
+ * The RIFF and data sizes are written as -1 since the length
+ * of the recording is not known up front.
+ *
+ * \param file stream positioned at the start of the file
+ * \param samp_rate in samples/second
+ * \param frequency center frequency in Hz
+ * \param bits_per_sample per I or Q component
+ */
+
+void wave_header(FILE *file, uint32_t samp_rate, uint32_t frequency, uint32_t bits_per_sample);
+
+/*!
+ * Write the WAVE headers with a given auxi chunk
+ *
+ * \param file stream positioned at the start of the file
+ * \param samp_rate in samples/second
+ * \param bits_per_sample 8 or 16 for PCM, 32 for float
+ * \param auxi start time, frequency and the rest, written as is
+ */
+
+void wave_header_auxi(FILE *file, uint32_t samp_rate, uint32_t bits_per_sample, const auxi_t *auxi);
+
+/*!
+ * Write the WAVE headers for any number of channels, e.g. to copy
+ * the fmt of another file
+ *
+ * \param file stream positioned at the start of the file
+ * \param samp_rate in samples/second
+ * \param channels 2 for I/Q, 1 for audio
+ * \param bits_per_sample 8 or 16 for PCM, 32 for float
+ * \param auxi start time, frequency and the rest, written as is
+ */
+
+void wave_header_channels(FILE *file, uint32_t samp_rate, uint16_t channels,
+    uint32_t bits_per_sample, const auxi_t *auxi);
+
+/*!
+ * Write the WAVE headers for a streamed 16 bit mono audio recording
+ *
+ * The same chunks as wave_header(), so wave_update_sizes() finishes
+ * it the same way.
+ *
+ * \param file stream positioned at the start of the file
+ * \param samp_rate audio samples/second
+ * \param frequency of the station in Hz, for the auxi chunk
+ */
+
+void wave_header_audio(FILE *file, uint32_t samp_rate, uint32_t frequency);
+
+/*!
+ * Write the WAVE headers of a circular capture
+ *
+ * A ring chunk goes ahead of the data chunk, whose size is the
+ * whole region.
+ *
+ * \param file stream positioned at the start of the file
+ * \param samp_rate in samples/second
+ * \param frequency center frequency in Hz
+ * \param region bytes of samples the capture cycles through
+ */
+
+void wave_header_ring(FILE *file, uint32_t samp_rate, uint32_t frequency, uint64_t region);
+
+/*!
+ * Rewrite the RIFF and data sizes in place without moving the file offset
+ *
+ * Sizes past the 4GB limit of a WAVE file are left at -1.
+ *
+ * \param fd of a file started with wave_header()
+ * \param data_bytes of samples after the header
+ * \return 0 on success
+ */
+
+int wave_update_sizes(int fd, uint64_t data_bytes);
+
+/*!
+ * Finish a capture with its sizes and a cue list after the data
+ *
+ * Each cue gets a labl chunk, and a ltxt region chunk when it has a
+ * length, in a LIST adtl chunk.  Nothing is appended when the data
+ * is past the 4GB limit, where the data size has to stay -1.
+ *
+ * \param fd of a file started with wave_header(), positioned anywhere
+ * \param data_bytes of samples after the header
+ * \param cues to write
+ * \param n number of cues
+ * \return 0 on success
+ */
+
+int wave_append_cues(int fd, uint64_t data_bytes, const wave_cue_t *cues, int n);
+
+/*!
+ * Read the fmt, auxi and data chunks of a WAVE file
+ *
+ * A data size of -1, as written by wave_header(), means the
+ * samples run to the end of the file.  The ring chunk of a circular
+ * capture is read too; its data is in write order only from the
+ * head, ring.written % ring.region, round to the head.
+ *
+ * \param fd of the WAVE file
+ * \param info to fill in
+ * \return 0 on success, -1 if the file is not a usable WAVE file
+ */
+
+int wave_read_header(int fd, struct wave_info *info);
+
+/*!
+ * Map bytes of a file through a window, remapping only when they are
+ * not in the window already
+ *
+ * The address space used stays at most one span whatever the size
+ * of the file, so captures larger than memory, or than the address
+ * space of a 32 bit machine, stream through the page cache.
+ *
+ * \param w the window, zeroed before the first call
+ * \param fd of the file
+ * \param offset of the first byte wanted
+ * \param len bytes wanted
+ * \param span bytes to map from offset when remapping, if more than len
+ * \return the byte at offset, or NULL if it could not be mapped
+ */
+
+const uint8_t *wave_window(struct wave_window *w, int fd, uint64_t offset, uint64_t len, uint64_t span);
+
+/*!
+ * Unmap a window
+ *
+ * \param w the window, zeroed again
+ */
+
+void wave_window_free(struct wave_window *w);
+
+#endif
@@ -0,0 +1,561 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+#include "rtl-sdr.h"
+#include "convenience.h"
+#include "metrics.h"
+#include "dsp.h"
+#include "wave.h"
+#include "writer.h"
+
+#define MINIMAL_BUF_LENGTH	512
+#define WRITER_BATCH		64	/* most blocks in one write */
+#define WRITER_MAX_ALIGN	(64 << 20)
+
+void writer_init(struct writer *w, FILE *file, struct pool *pool)
+{
+	memset(w, 0, sizeof(*w));
+	fflush(file);
+	w->file = file;
+	w->fd = fileno(file);
+	w->pool = pool;
+	w->cpu = -1;
+	w->data_offset = WAVE_HEADER_SIZE;
+	w->out_bits = 8;
+	pthread_mutex_init(&w->mark_lock, NULL);
+}
+
+void writer_sigmf(struct writer *w, struct sigmf *m, int bits)
+{
+	w->sigmf = m;
+	w->data_offset = 0;
+	w->out_bits = bits;
+}
+
+void writer_adaptive(struct writer *w, uint32_t max_size, int latency_ms)
+{
+	uint32_t step = w->pool->block_size;
+	/* leave half the pool for the capture side while a batch fills */
+	int most = w->pool->count / 2 < WRITER_BATCH ? w->pool->count / 2 : WRITER_BATCH;
+	if (most < 1) {
+		most = 1;}
+	if (max_size > step * most) {
+		max_size = step * most;}
+	w->adaptive = 1;
+	adapt_init(&w->adapt, "write", step, MINIMAL_BUF_LENGTH, max_size,
+		step, latency_ms);
+}
+
+int writer_live_header(struct writer *w, int seconds)
+{
+	struct stat st;
+	if (fstat(w->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "WARNING: Output is not a file, header sizes stay at -1.\n");
+		return -1;
+	}
+	w->header_interval = (uint64_t)seconds * 1000000;
+	if (!w->header_interval) {
+		w->header_interval = 1;}
+	w->header_time = metrics_now();
+	return 0;
+}
+
+int writer_ring(struct writer *w, uint64_t region)
+{
+	struct stat st;
+	int r;
+	if (fstat(w->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "A circular capture needs a file.\n");
+		return -1;
+	}
+	r = posix_fallocate(w->fd, 0, WAVE_RING_HEADER_SIZE + region);
+	if (r != 0) {
+		fprintf(stderr, "Failed to preallocate %llu bytes: %s\n",
+			(unsigned long long)(WAVE_RING_HEADER_SIZE + region), strerror(r));
+		return -1;
+	}
+	w->ring_region = region;
+	return 0;
+}
+
+int writer_writeback(struct writer *w, uint64_t window, uint64_t keep)
+{
+	struct stat st;
+	if (fstat(w->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "WARNING: Output is not a file, writeback left to the kernel.\n");
+		return -1;
+	}
+	w->writeback = window;
+	w->keep = keep;
+	return 0;
+}
+
+int writer_align(struct writer *w, uint32_t align)
+{
+	/* pages and erase blocks are powers of two, anything else
+	 * would only look aligned */
+	if (!align || align > WRITER_MAX_ALIGN || (align & (align - 1))) {
+		fprintf(stderr, "WARNING: Write alignment must be a power of two from 1 to %d bytes.\n",
+			WRITER_MAX_ALIGN);
+		return -1;
+	}
+	w->carry = malloc(align);
+	w->spare = malloc(align);
+	if (!w->carry || !w->spare) {
+		free(w->carry);
+		free(w->spare);
+		w->carry = w->spare = NULL;
+		return -1;
+	}
+	w->align = align;
+	return 0;
+}
+
+/* pwrite all of iov at the ring head, wrapping round the region */
+static size_t writer_pwrite_ring(struct writer *w, struct iovec *iov, int n)
+{
+	size_t total = 0, len;
+	uint64_t at;
+	uint8_t *p;
+	ssize_t r;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		p = iov[i].iov_base;
+		len = iov[i].iov_len;
+		while (len) {
+			size_t piece = len;
+			at = (w->data_bytes + total) % w->ring_region;
+			if (piece > w->ring_region - at) {
+				piece = w->ring_region - at;}
+			r = pwrite(w->fd, p, piece, WAVE_RING_HEADER_SIZE + at);
+			if (r < 0 && errno == EINTR) {
+				continue;}
+			if (r <= 0) {
+				return total;}
+			p += r;
+			len -= r;
+			total += r;
+		}
+	}
+	return total;
+}
+
+static void writer_update_header(struct writer *w)
+{
+	w->header_time = metrics_now();
+	/* only what is in the file, not the bytes held back */
+	if (wave_update_sizes(w->fd, w->data_bytes - w->carry_len) < 0) {
+		fprintf(stderr, "WARNING: Failed to update header sizes.\n");}
+}
+
+static size_t writer_iov_bytes(struct iovec *iov, int n)
+{
+	size_t total = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		total += iov[i].iov_len;}
+	return total;
+}
+
+/* writev all of iov at the file position, returns bytes written */
+static size_t writer_writev_all(int fd, struct iovec *iov, int n)
+{
+	size_t total = 0;
+	ssize_t r;
+
+	while (n) {
+		r = writev(fd, iov, n);
+		if (r < 0 && errno == EINTR) {
+			continue;}
+		if (r <= 0) {
+			break;}
+		total += r;
+		while (n && (size_t)r >= iov->iov_len) {
+			r -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n) {
+			iov->iov_base = (uint8_t *)iov->iov_base + r;
+			iov->iov_len -= r;
+		}
+	}
+	return total;
+}
+
+/* write iov after the bytes held back, up to the last aligned offset,
+ * and hold back the rest; returns the bytes of iov taken */
+static size_t writer_writev_aligned(struct writer *w, struct iovec *iov, int n)
+{
+	struct iovec all[WRITER_BATCH + 1];
+	size_t len = writer_iov_bytes(iov, n), pending, rem, piece, done;
+	uint64_t end = w->data_offset + w->data_bytes + len;
+	uint8_t *swap;
+	int m = 0, i;
+
+	if (w->carry_len) {
+		all[m].iov_base = w->carry;
+		all[m++].iov_len = w->carry_len;
+	}
+	for (i = 0; i < n; i++) {
+		all[m++] = iov[i];}
+	pending = w->carry_len + len;
+	rem = end % w->align;
+	if (rem > pending) {
+		rem = pending;}
+
+	/* copy the tail aside and leave only the aligned part in all */
+	for (done = 0; done < rem; m--) {
+		piece = all[m - 1].iov_len;
+		if (piece > rem - done) {
+			piece = rem - done;}
+		all[m - 1].iov_len -= piece;
+		memcpy(w->spare + rem - done - piece,
+			(uint8_t *)all[m - 1].iov_base + all[m - 1].iov_len, piece);
+		done += piece;
+		if (all[m - 1].iov_len) {
+			break;}
+	}
+	if (writer_writev_all(w->fd, all, m) != pending - rem) {
+		return 0;}
+	swap = w->carry;
+	w->carry = w->spare;
+	w->spare = swap;
+	w->carry_len = rem;
+	return len;
+}
+
+/* start writeback of each full window of the file, wait for the one
+ * before it, and drop the pages that are keep bytes behind */
+static void writer_flush_windows(struct writer *w)
+{
+	uint64_t end = w->data_offset + w->data_bytes - w->carry_len;
+	uint64_t t, target;
+
+	while (end - w->flushed >= w->writeback) {
+		sync_file_range(w->fd, w->flushed, w->writeback, SYNC_FILE_RANGE_WRITE);
+		if (w->flushed >= w->writeback) {
+			t = metrics_now();
+			sync_file_range(w->fd, w->flushed - w->writeback, w->writeback,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+				SYNC_FILE_RANGE_WAIT_AFTER);
+			metrics_observe(H_WRITEBACK_WAIT, metrics_now() - t);
+		}
+		w->flushed += w->writeback;
+	}
+	/* everything before the window in flight is on the disk */
+	if (w->flushed < w->writeback + w->keep) {
+		return;}
+	target = w->flushed - w->writeback - w->keep;
+	if (target - w->dropped >= w->writeback) {
+		posix_fadvise(w->fd, w->dropped, target - w->dropped, POSIX_FADV_DONTNEED);
+		w->dropped = target;
+	}
+}
+
+/* write all of iov, returns bytes written */
+static size_t writer_writev(struct writer *w, struct iovec *iov, int n)
+{
+	size_t total, want = writer_iov_bytes(iov, n);
+	int short_write;
+	uint64_t t = metrics_now();
+
+	if (w->ring_region) {
+		total = writer_pwrite_ring(w, iov, n);
+	} else if (w->align) {
+		total = writer_writev_aligned(w, iov, n);
+	} else {
+		total = writer_writev_all(w->fd, iov, n);}
+	short_write = total != want;
+	metrics_observe(H_WRITE_LATENCY, metrics_now() - t);
+	metrics_add(C_BYTES_WRITTEN, total);
+	if (short_write) {
+		metrics_add(C_SHORT_WRITES, 1);}
+	w->data_bytes += total;
+	/* one aligned 8 byte write, so the head and wrap count change together */
+	if (w->ring_region && total &&
+	    pwrite(w->fd, &w->data_bytes, sizeof(w->data_bytes), WAVE_RING_WRITTEN_OFFSET) != sizeof(w->data_bytes)) {
+		fprintf(stderr, "WARNING: Failed to update the ring head.\n");}
+	if (w->writeback && !w->ring_region) {
+		writer_flush_windows(w);}
+	/* the samples are in the file by now, so the sizes never run ahead of them */
+	if (w->header_interval && metrics_now() - w->header_time >= w->header_interval) {
+		writer_update_header(w);}
+	return total;
+}
+
+size_t writer_write(struct writer *w, const void *buf, size_t len)
+{
+	struct iovec iov;
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	return writer_writev(w, &iov, 1);
+}
+
+void writer_mark(struct writer *w, uint64_t sample, uint32_t length,
+	uint32_t frequency, const char *label)
+{
+	struct writer_mark *m;
+	/* frames of a circular capture are reused, a cue would go stale */
+	if (w->ring_region) {
+		return;}
+	pthread_mutex_lock(&w->mark_lock);
+	m = realloc(w->marks, (w->nmarks + 1) * sizeof(*m));
+	if (!m) {
+		pthread_mutex_unlock(&w->mark_lock);
+		fprintf(stderr, "WARNING: Out of memory, cue %s not marked.\n", label);
+		return;
+	}
+	w->marks = m;
+	m = &w->marks[w->nmarks++];
+	memset(m, 0, sizeof(*m));
+	m->sample = sample;
+	m->frequency = frequency;
+	m->cue.length = length;
+	snprintf(m->cue.label, sizeof(m->cue.label), "%s", label);
+	pthread_mutex_unlock(&w->mark_lock);
+}
+
+/* sample frame of the output at a byte offset */
+static uint64_t writer_frame(struct writer *w, uint64_t offset)
+{
+	return (offset - w->data_offset) / (w->out_bits / 4);
+}
+
+/* place the marks that fall before the end of a block just written
+ * at offset, returns the number placed */
+static int writer_place_marks(struct writer *w, struct block *b, uint64_t offset)
+{
+	uint64_t frames = b->len / 2;
+	int i, placed = 0;
+	pthread_mutex_lock(&w->mark_lock);
+	for (i = 0; i < w->nmarks; i++) {
+		struct writer_mark *m = &w->marks[i];
+		if (m->written || m->sample >= b->sample + frames) {
+			continue;}
+		m->cue.position = writer_frame(w, offset);
+		if (m->sample > b->sample) {
+			m->cue.position += m->sample - b->sample;}
+		m->written = 1;
+		placed++;
+		if (!w->sigmf) {
+			continue;}
+		if (m->frequency) {
+			sigmf_capture(w->sigmf, m->cue.position, m->frequency, 0);}
+		sigmf_annotate(w->sigmf, m->cue.position, m->cue.length, m->cue.label);
+	}
+	pthread_mutex_unlock(&w->mark_lock);
+	return placed;
+}
+
+/* start a SigMF capture segment where samples were lost before a block
+ * just written at offset, and time the first one; returns 1 if one was */
+static int writer_sigmf_gap(struct writer *w, struct block *b, uint64_t offset)
+{
+	uint64_t position = writer_frame(w, offset);
+	int64_t start_ns = metrics_wallclock_ns(b->time) -
+		(int64_t)(b->len / 2) * 1000000000 / w->sigmf->samp_rate;
+	char label[WAVE_LABEL];
+	int r = 0;
+
+	if (!w->started) {
+		sigmf_capture(w->sigmf, 0, 0, start_ns);
+		r = 1;
+	} else if (b->sample > w->next_sample) {
+		sigmf_capture(w->sigmf, position, 0, start_ns);
+		snprintf(label, sizeof(label), "%llu samples lost",
+			(unsigned long long)(b->sample - w->next_sample));
+		sigmf_annotate(w->sigmf, position, 0, label);
+		r = 1;
+	}
+	w->started = 1;
+	w->next_sample = b->sample + b->len / 2;
+	return r;
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer *w = arg;
+	struct block *batch[WRITER_BATCH];
+	struct iovec iov[WRITER_BATCH];
+	uint32_t crcs[WRITER_BATCH];
+	struct block *b;
+	uint64_t t, deadline;
+	size_t bytes, out_bytes;
+	uint8_t *out;
+	int i, n, changed;
+
+	verbose_cpu_affinity("writer", w->cpu);
+	while ((b = queue_pop(&w->queue)) != NULL) {
+		batch[0] = b;
+		bytes = b->len;
+		n = 1;
+		if (w->adaptive) {
+			/* wait at most half the latency target for more blocks */
+			deadline = w->adapt.latency ? b->time + w->adapt.latency / 2 : 0;
+			while (bytes < w->adapt.size && n < WRITER_BATCH &&
+			       (b = queue_pop_until(&w->queue, deadline)) != NULL) {
+				batch[n++] = b;
+				bytes += b->len;
+			}
+		}
+		out_bytes = bytes * w->out_bits / 8;
+		if (w->out_bits != 8 && out_bytes > w->scratch_len) {
+			w->scratch = realloc(w->scratch, out_bytes);
+			w->scratch_len = out_bytes;
+		}
+		out = w->scratch;
+		for (i = 0; i < n; i++) {
+			if (w->process) {
+				w->process(batch[i], w->process_ctx);}
+			iov[i].iov_base = batch[i]->data;
+			iov[i].iov_len = batch[i]->len;
+			/* blocks go out as they are unless a wider type is asked for */
+			if (w->out_bits != 8) {
+				widen_s8((const int8_t *)batch[i]->data, out, batch[i]->len, w->out_bits);
+				iov[i].iov_base = out;
+				iov[i].iov_len = (size_t)batch[i]->len * w->out_bits / 8;
+				out += iov[i].iov_len;
+			}
+			/* while the block is still in cache */
+			if (w->checksum) {
+				crcs[i] = crc32c(0, iov[i].iov_base, iov[i].iov_len);}
+			if (w->overview && !w->failed) {
+				overview_block(w->overview, batch[i]);}
+		}
+		if (!w->failed) {
+			uint64_t offset = w->data_offset + w->data_bytes;
+			uint32_t len;
+			t = metrics_now();
+			if (writer_writev(w, iov, n) != out_bytes) {
+				fprintf(stderr, "Short write, samples lost, exiting!\n");
+				w->failed = 1;
+			} else {
+				changed = 0;
+				for (i = 0; i < n; i++) {
+					len = batch[i]->len * w->out_bits / 8;
+					if (w->index) {
+						index_block(w->index, batch[i], offset);}
+					if (w->checksum) {
+						checksum_record(w->checksum, offset, len, crcs[i]);}
+					if (w->sigmf) {
+						changed += writer_sigmf_gap(w, batch[i], offset);}
+					changed += writer_place_marks(w, batch[i], offset);
+					offset += len;
+				}
+				if (w->sigmf && changed) {
+					sigmf_write(w->sigmf);}
+			}
+			if (w->adaptive) {
+				adapt_update(&w->adapt, metrics_now() - t,
+					metrics_now() - batch[0]->time);}
+		}
+		for (i = 0; i < n; i++) {
+			pool_put(w->pool, batch[i]);}
+	}
+	return NULL;
+}
+
+static void writer_write_cues(struct writer *w)
+{
+	struct stat st;
+	wave_cue_t *cues = malloc(w->nmarks * sizeof(wave_cue_t));
+	int i, n = 0;
+
+	/* without them the sizes are still worth finishing */
+	if (!cues) {
+		fprintf(stderr, "WARNING: Out of memory, %d cues not written.\n", w->nmarks);}
+	for (i = 0; cues && i < w->nmarks; i++) {
+		if (w->marks[i].written) {
+			cues[n++] = w->marks[i].cue;}
+	}
+	if (fstat(w->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		fprintf(stderr, "WARNING: Output is not a file, %d cues not written.\n", n);
+	} else if (wave_append_cues(w->fd, w->data_bytes, cues, n) < 0) {
+		fprintf(stderr, "WARNING: Failed to write %d cues.\n", n);}
+	free(cues);
+}
+
+int writer_start(struct writer *w, int cpu)
+{
+	w->cpu = cpu;
+	if (queue_init(&w->queue, w->pool->count) < 0) {
+		return -1;}
+	if (pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+		fprintf(stderr, "Failed to start writer thread.\n");
+		queue_free(&w->queue);
+		return -1;
+	}
+	w->running = 1;
+	return 0;
+}
+
+int writer_submit(struct writer *w, struct block *b)
+{
+	int depth = queue_push(&w->queue, b);
+	if (depth < 0) {
+		pool_put(w->pool, b);
+		return -1;
+	}
+	metrics_observe(H_QUEUE_DEPTH, depth);
+	return 0;
+}
+
+void writer_drain(struct writer *w)
+{
+	if (w->running) {
+		queue_close(&w->queue);
+		pthread_join(w->thread, NULL);
+		queue_free(&w->queue);
+		w->running = 0;
+	}
+}
+
+void writer_stop(struct writer *w)
+{
+	writer_drain(w);
+	if (w->carry_len) {
+		struct iovec iov = {w->carry, w->carry_len};
+		if (writer_writev_all(w->fd, &iov, 1) != w->carry_len) {
+			fprintf(stderr, "WARNING: Failed to write the last %u bytes.\n", w->carry_len);}
+		w->carry_len = 0;
+	}
+	free(w->carry);
+	free(w->spare);
+	w->carry = w->spare = NULL;
+	if (w->header_interval) {
+		writer_update_header(w);}
+	/* a SigMF capture has its marks in the metadata already */
+	if (w->nmarks && !w->sigmf) {
+		writer_write_cues(w);}
+	free(w->marks);
+	w->marks = NULL;
+	w->nmarks = 0;
+	free(w->scratch);
+	w->scratch = NULL;
+}
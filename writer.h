@@ -0,0 +1,247 @@
+/*
+ * rtl_wave, streams rtl-sdr samples into a WAVE file
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __WRITER_H
+#define __WRITER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "adapt.h"
+#include "index.h"
+#include "checksum.h"
+#include "overview.h"
+#include "sigmf.h"
+#include "wave.h"
+
+/* a tuning change waiting for the block that holds its sample */
+struct writer_mark {
+	uint64_t sample;	/* stream sample index */
+	uint32_t frequency;	/* tuned to, 0 if the mark is not a retune */
+	int written;		/* cue.position is final */
+	wave_cue_t cue;
+};
+
+/* writes converted sample blocks to the output, either inline or
+ * from its own thread fed through a queue */
+
+struct writer {
+	FILE *file;
+	int fd;
+	struct pool *pool;
+	struct queue queue;
+	pthread_t thread;
+	int cpu;
+	int running;
+	int adaptive;		/* coalesce blocks into adapt.size writes */
+	struct adapt adapt;
+	/* optional work on each block in the writer thread before it is written */
+	void (*process)(struct block *b, void *ctx);
+	void *process_ctx;
+	uint64_t data_offset;	/* bytes of header before the samples */
+	uint64_t data_bytes;	/* samples written after the header */
+	int out_bits;		/* per I or Q written, 8 for the blocks as they are */
+	uint8_t *scratch;	/* blocks widened to out_bits */
+	size_t scratch_len;
+	struct sigmf *sigmf;	/* metadata of a bare SigMF data file, or NULL */
+	uint64_t next_sample;	/* stream sample expected next, to find gaps */
+	int started;
+	uint64_t header_interval; /* us between header size updates, 0 for none */
+	uint64_t header_time;
+	struct index *index;	/* seek index of the written blocks, or NULL */
+	struct checksum *checksum; /* CRC32C of each written block, or NULL */
+	struct overview *overview; /* power pyramid of the written blocks, or NULL */
+	volatile int failed;	/* set after a short write */
+	uint64_t ring_region;	/* bytes the samples cycle through, 0 for a plain file */
+	uint64_t writeback;	/* bytes per writeback window, 0 to leave it to the kernel */
+	uint64_t keep;		/* bytes behind the flushed edge left in the page cache */
+	uint64_t flushed;	/* file offset writeback was started up to */
+	uint64_t dropped;	/* file offset the page cache was dropped up to */
+	uint32_t align;		/* writes end on a multiple of this offset, 0 for any */
+	uint8_t *carry, *spare;	/* the bytes held back past the last aligned offset */
+	uint32_t carry_len;	/* counted in data_bytes but not yet written */
+	pthread_mutex_t mark_lock;
+	struct writer_mark *marks; /* cues written after the data at the end */
+	int nmarks;
+};
+
+/*!
+ * Prepare a writer for inline writes
+ *
+ * The stream is flushed and written through its file descriptor
+ * from here on.
+ *
+ * \param w the writer
+ * \param file output stream, already past the WAVE header
+ * \param pool blocks submitted to the writer are returned here
+ */
+
+void writer_init(struct writer *w, FILE *file, struct pool *pool);
+
+/*!
+ * Let the writer thread coalesce queued blocks into larger writes
+ *
+ * \param w the writer
+ * \param max_size largest write in bytes
+ * \param latency_ms target for samples to reach the output, 0 for none
+ */
+
+void writer_adaptive(struct writer *w, uint32_t max_size, int latency_ms);
+
+/*!
+ * Keep the WAVE header sizes current so readers can follow the live edge
+ *
+ * \param w the writer
+ * \param seconds between updates
+ * \return 0 on success, -1 if the output cannot be rewritten in place
+ */
+
+int writer_live_header(struct writer *w, int seconds);
+
+/*!
+ * Write a circular capture: preallocate the region and wrap round it
+ *
+ * After each write the count of bytes written is stored in the ring
+ * chunk with a single 8 byte write, so a reader always finds a
+ * consistent head and wrap count.
+ *
+ * \param w the writer, on a file started with wave_header_ring()
+ * \param region bytes of samples to keep
+ * \return 0 on success
+ */
+
+int writer_ring(struct writer *w, uint64_t region);
+
+/*!
+ * Write the file back steadily instead of in bursts
+ *
+ * Writeback of each full window is started as soon as it is written,
+ * and the window before it is waited for, so at most two windows are
+ * dirty at any time.  Pages more than keep bytes behind the flushed
+ * edge are dropped from the page cache, after readers following the
+ * live edge have had them.
+ *
+ * \param w the writer
+ * \param window bytes per writeback window
+ * \param keep bytes left cached behind the flushed edge
+ * \return 0 on success, -1 if the output is not a file
+ */
+
+int writer_writeback(struct writer *w, uint64_t window, uint64_t keep);
+
+/*!
+ * End every write on a multiple of align in the file
+ *
+ * The bytes past the last multiple are held back for the next write,
+ * and written by writer_stop() at the end.
+ *
+ * \param w the writer
+ * \param align bytes, a power of two, 4096 for pages or the erase
+ *        block of an SD card
+ * \return 0 on success
+ */
+
+int writer_align(struct writer *w, uint32_t align);
+
+/*!
+ * Write a bare SigMF data file, with its metadata kept alongside
+ *
+ * Blocks are written as they are for ci8 and widened for the other
+ * types.  Gaps start a new capture segment with the time of the next
+ * sample, and marks become annotations, with a capture segment for
+ * a retune.
+ *
+ * \param w the writer, on a file with nothing written yet
+ * \param m metadata from sigmf_open()
+ * \param bits 8, 16 or 32 for float
+ */
+
+void writer_sigmf(struct writer *w, struct sigmf *m, int bits);
+
+/*!
+ * Start the writer thread
+ *
+ * \param w the writer
+ * \param cpu to pin the thread to, negative for none
+ * \return 0 on success
+ */
+
+int writer_start(struct writer *w, int cpu);
+
+/*!
+ * Queue a block for the writer thread, never waits
+ *
+ * \param w the writer
+ * \param b block to write, given back to the pool once written
+ * \return 0 on success
+ */
+
+int writer_submit(struct writer *w, struct block *b);
+
+/*!
+ * Write samples now and record the latency
+ *
+ * \param w the writer
+ * \param buf samples
+ * \param len bytes
+ * \return bytes written
+ */
+
+size_t writer_write(struct writer *w, const void *buf, size_t len);
+
+/*!
+ * Mark a stream sample with a cue in the output
+ *
+ * The mark lands on the sample in the file once the block holding
+ * it is written, or on the next written sample if it was lost.
+ * The cues are written after the data by writer_stop(), or go to
+ * the SigMF metadata as soon as they land.
+ *
+ * \param w the writer
+ * \param sample stream sample index, as in struct block
+ * \param length samples of the region starting there, 0 for a point
+ * \param frequency tuned to from there, 0 if this is not a retune
+ * \param label text of the cue
+ */
+
+void writer_mark(struct writer *w, uint64_t sample, uint32_t length,
+	uint32_t frequency, const char *label);
+
+/*!
+ * Write out the queue and join the writer thread
+ *
+ * Nothing the thread wrote is still in flight once this returns.
+ * The file is finished later by writer_stop().
+ *
+ * \param w the writer
+ */
+
+void writer_drain(struct writer *w);
+
+/*!
+ * Drain the queue and stop the writer thread
+ *
+ * Marks are written as a cue list when the output is a file.
+ *
+ * \param w the writer
+ */
+
+void writer_stop(struct writer *w);
+
+#endif